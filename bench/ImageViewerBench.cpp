@@ -0,0 +1,480 @@
+/// Throughput benchmarks for ImageViewer.
+///
+/// Generates its own datasets in a temporary directory, times directory
+/// scans, sorting, decodes per format and size, and navigation through
+/// ImageLoader the way the main window drives it, then writes the results
+/// as JSON. Build with -DIMAGEVIEWER_BUILD_BENCH=ON.
+///
+///   ImageViewerBench [--quick] [--repeat N] [--output results.json]
+///
+/// The disk cache is redirected into the temporary directory so every run
+/// starts cold. Preferences are the machine's own and are recorded in the
+/// output, since they decide cache and prefetch sizes.
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QGuiApplication>
+#include <QImage>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+
+#include "ImageFileIndex.hpp"
+#include "ImageLoader.hpp"
+#include "PixelKernels.hpp"
+#include "Preferences.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+constexpr int NAVIGATION_TIMEOUT_MS = 60'000;
+const QSize SCREEN_SIZE(2560, 1440);
+
+struct Config {
+  bool quick{false};
+  int repeat{5};
+  std::vector<QSize> imageSizes;
+  std::vector<int> directorySizes;
+  int navigationImages{24};
+  QSize navigationImageSize;
+};
+
+double elapsedMs(const QElapsedTimer &timer) {
+  return timer.nsecsElapsed() / 1e6;
+}
+
+QJsonObject summarize(std::vector<double> samples) {
+  QJsonObject result;
+  if (samples.empty()) {
+    return result;
+  }
+
+  QJsonArray values;
+  for (double sample : samples) {
+    values.append(sample);
+  }
+  result["samples_ms"] = values;
+
+  std::sort(samples.begin(), samples.end());
+  const auto count = samples.size();
+  result["min_ms"] = samples.front();
+  result["max_ms"] = samples.back();
+  result["median_ms"] = count % 2 ? samples[count / 2]
+                                   : (samples[count / 2 - 1] +
+                                      samples[count / 2]) /
+                                         2.0;
+  result["mean_ms"] =
+      std::accumulate(samples.begin(), samples.end(), 0.0) / count;
+  return result;
+}
+
+QJsonObject measure(const QString &name, const QJsonObject &parameters,
+                    int repeat, const std::function<void()> &run) {
+  std::vector<double> samples;
+  for (int i = 0; i < repeat; ++i) {
+    QElapsedTimer timer;
+    timer.start();
+    run();
+    samples.push_back(elapsedMs(timer));
+  }
+
+  auto result = summarize(std::move(samples));
+  result["name"] = name;
+  result["parameters"] = parameters;
+  qInfo().noquote() << name << QJsonDocument(parameters).toJson(
+                                   QJsonDocument::Compact)
+                    << result["median_ms"].toDouble() << "ms";
+  return result;
+}
+
+/// Smooth gradients with a little noise, so encoders work about as hard
+/// as on photographs instead of collapsing flat areas
+QImage syntheticImage(const QSize &size) {
+  QImage image(size, QImage::Format_RGB32);
+  quint32 state = 0x2545f491u;
+  for (int y = 0; y < size.height(); ++y) {
+    auto *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+    for (int x = 0; x < size.width(); ++x) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      const int noise = int(state & 15) - 8;
+      const int r = std::clamp(x * 255 / size.width() + noise, 0, 255);
+      const int g = std::clamp(y * 255 / size.height() + noise, 0, 255);
+      const int b = std::clamp(((x / 64 + y / 64) % 2) * 128 + 64 + noise, 0,
+                               255);
+      line[x] = qRgb(r, g, b);
+    }
+  }
+  return image;
+}
+
+QString sizeName(const QSize &size) {
+  return QString("%1x%2").arg(size.width()).arg(size.height());
+}
+
+/// Formats the viewer opens that this Qt build can also write
+std::vector<QByteArray> writableFormats() {
+  const auto supported = QImageWriter::supportedImageFormats();
+  std::vector<QByteArray> formats;
+  for (const QByteArray format : {"jpg", "png", "webp", "tiff"}) {
+    if (supported.contains(format)) {
+      formats.push_back(format);
+    } else {
+      qWarning() << "No image writer for" << format << "- skipped";
+    }
+  }
+  return formats;
+}
+
+/// Empty files with image names and spread out sizes and dates. Scanning
+/// and sorting only look at names and stat data, so no pixels are needed
+QString makeListingDirectory(const QString &root, int count) {
+  const QString directory = root + QString("/listing-%1").arg(count);
+  QDir().mkpath(directory);
+
+  const QDateTime base = QDateTime::currentDateTime().addDays(-365);
+  static const char *extensions[] = {"jpg", "png", "nef", "tiff", "webp"};
+  for (int i = 0; i < count; ++i) {
+    QFile file(directory + QString("/IMG_%1.%2")
+                               .arg((i * 7919) % count, 6, 10, QChar('0'))
+                               .arg(extensions[i % 5]));
+    if (!file.open(QIODevice::WriteOnly)) {
+      continue;
+    }
+    file.resize((i * 104729) % (16 * 1024 * 1024));
+    file.setFileTime(base.addSecs((i * 6007) % (365 * 24 * 3600)),
+                     QFileDevice::FileModificationTime);
+  }
+  return directory;
+}
+
+QJsonArray benchScan(const Config &config, const QString &root) {
+  QJsonArray results;
+  for (int count : config.directorySizes) {
+    const QString directory = makeListingDirectory(root, count);
+
+    double firstBatchMs = 0;
+    std::size_t listed = 0;
+    auto result = measure(
+        "scan", {{"files", count}}, config.repeat, [&]() {
+          QElapsedTimer timer;
+          timer.start();
+          std::atomic<bool> cancelled{false};
+          listed = 0;
+          firstBatchMs = -1;
+          scanImageFiles(directory, QString(), cancelled,
+                         [&](std::vector<QString> batch, bool) {
+                           if (firstBatchMs < 0) {
+                             firstBatchMs = elapsedMs(timer);
+                           }
+                           listed += batch.size();
+                         });
+        });
+    result["first_batch_ms"] = firstBatchMs;
+    result["listed"] = qint64(listed);
+    results.append(result);
+
+    std::vector<QString> paths;
+    std::atomic<bool> cancelled{false};
+    scanImageFiles(directory, QString(), cancelled,
+                   [&](std::vector<QString> batch, bool) {
+                     paths.insert(paths.end(), batch.begin(), batch.end());
+                   });
+
+    ImageFileIndex index;
+    results.append(measure("index_assign", {{"files", count}},
+                           config.repeat, [&]() { index.assign(paths); }));
+
+    /// Once, the disk cache has the EXIF data of every file afterwards
+    results.append(measure("index_read_metadata", {{"files", count}}, 1,
+                           [&]() { index.readMetadata(); }));
+
+    const std::pair<SortBy, const char *> sortKeys[] = {
+        {SortBy::name, "name"},
+        {SortBy::size, "size"},
+        {SortBy::date_modified, "date_modified"},
+        {SortBy::capture_time, "capture_time"},
+        {SortBy::camera, "camera"}};
+    const std::pair<SortOrder, const char *> sortOrders[] = {
+        {SortOrder::ascending, "ascending"},
+        {SortOrder::descending, "descending"}};
+    for (const auto &[by, byName] : sortKeys) {
+      for (const auto &[order, orderName] : sortOrders) {
+        /// Start every run from the same shuffled order
+        std::vector<double> samples;
+        for (int i = 0; i < config.repeat; ++i) {
+          ImageFileIndex unsorted = index;
+          QElapsedTimer timer;
+          timer.start();
+          unsorted.sort(by, order);
+          samples.push_back(elapsedMs(timer));
+        }
+        auto result = summarize(std::move(samples));
+        result["name"] = "sort";
+        result["parameters"] = QJsonObject{
+            {"files", count}, {"by", byName}, {"order", orderName}};
+        qInfo() << "sort" << count << byName << orderName
+                << result["median_ms"].toDouble() << "ms";
+        results.append(result);
+      }
+    }
+  }
+  return results;
+}
+
+QJsonArray benchDecode(const Config &config, const QString &root) {
+  QJsonArray results;
+  const QString directory = root + "/decode";
+  QDir().mkpath(directory);
+
+  for (const auto &size : config.imageSizes) {
+    const QImage image = syntheticImage(size);
+    for (const auto &format : writableFormats()) {
+      const QString path = directory + QString("/%1.%2")
+                                           .arg(sizeName(size))
+                                           .arg(QString::fromLatin1(format));
+      if (!image.save(path, format.constData())) {
+        qWarning() << "Could not write" << path;
+        continue;
+      }
+
+      const QJsonObject parameters{{"format", QString::fromLatin1(format)},
+                                   {"size", sizeName(size)},
+                                   {"bytes", QFileInfo(path).size()}};
+
+      DecodeOptions fullOptions;
+      auto full = measure("decode_full", parameters, config.repeat, [&]() {
+        QPixmap pixmap;
+        ImageLoader::loadImageIntoPixmap(path, fullOptions, pixmap);
+      });
+      results.append(full);
+
+      DecodeOptions screenOptions;
+      screenOptions.targetSize = SCREEN_SIZE;
+      auto screen =
+          measure("decode_screen", parameters, config.repeat, [&]() {
+            QPixmap pixmap;
+            ImageLoader::loadImageIntoPixmap(path, screenOptions, pixmap);
+          });
+      results.append(screen);
+    }
+  }
+  return results;
+}
+
+/// Drives an ImageLoader on its own thread like MainWindow does and
+/// times each request until the matching imageLoaded arrives
+QJsonArray benchNavigation(const Config &config, const QString &root) {
+  QJsonArray results;
+  const QString directory = root + "/navigation";
+  QDir().mkpath(directory);
+
+  const QImage image = syntheticImage(config.navigationImageSize);
+  for (int i = 0; i < config.navigationImages; ++i) {
+    image.save(directory + QString("/frame_%1.jpg").arg(i, 4, 10, QChar('0')),
+               "jpg");
+  }
+
+  auto *imageLoader = new ImageLoader;
+  QThread imageLoaderThread;
+  imageLoader->moveToThread(&imageLoaderThread);
+  imageLoaderThread.start();
+
+  QEventLoop loop;
+  QTimer timeout;
+  timeout.setSingleShot(true);
+  QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop]() {
+    qWarning() << "Timed out waiting for the image loader";
+    loop.exit(1);
+  });
+
+  /// The rest of the folder arrives from the background scan
+  QEventLoop scanLoop;
+  std::size_t listed = 0;
+  auto countListed = [&](std::size_t count) {
+    listed = count;
+    if (listed >= std::size_t(config.navigationImages)) {
+      scanLoop.quit();
+    }
+  };
+  QObject::connect(imageLoader, &ImageLoader::imageFilesChanged, &scanLoop,
+                   [&](const ImageFileIndex::Snapshot &imageFiles) {
+                     countListed(imageFiles->size());
+                   });
+  QObject::connect(imageLoader, &ImageLoader::imageFilesInserted, &scanLoop,
+                   [&](const ImageFileIndex &batch) {
+                     countListed(listed + batch.size());
+                   });
+  QObject::connect(imageLoader, &ImageLoader::imageLoaded, &loop,
+                   [&loop]() { loop.exit(0); });
+
+  auto waitForImage = [&]() {
+    timeout.start(NAVIGATION_TIMEOUT_MS);
+    const int status = loop.exec();
+    timeout.stop();
+    return status == 0;
+  };
+
+  const QJsonObject parameters{
+      {"images", config.navigationImages},
+      {"size", sizeName(config.navigationImageSize)},
+      {"viewport", sizeName(SCREEN_SIZE)}};
+
+  QMetaObject::invokeMethod(imageLoader, [imageLoader]() {
+    imageLoader->setViewportSize(SCREEN_SIZE);
+  });
+
+  QElapsedTimer timer;
+  timer.start();
+  QMetaObject::invokeMethod(imageLoader, [imageLoader, directory]() {
+    imageLoader->loadImage(directory + "/frame_0000.jpg");
+  });
+  if (waitForImage()) {
+    QJsonObject result{{"name", "open_first_image"},
+                       {"parameters", parameters},
+                       {"ms", elapsedMs(timer)}};
+    results.append(result);
+  }
+
+  if (listed < std::size_t(config.navigationImages)) {
+    QTimer::singleShot(NAVIGATION_TIMEOUT_MS, &scanLoop, &QEventLoop::quit);
+    scanLoop.exec();
+  }
+
+  std::vector<double> samples;
+  for (int i = 1; i < config.navigationImages; ++i) {
+    timer.restart();
+    QMetaObject::invokeMethod(imageLoader,
+                              [imageLoader]() { imageLoader->nextImage(); });
+    if (!waitForImage()) {
+      break;
+    }
+    samples.push_back(elapsedMs(timer));
+  }
+
+  auto result = summarize(std::move(samples));
+  result["name"] = "next_image";
+  result["parameters"] = parameters;
+  qInfo() << "next_image" << result["median_ms"].toDouble() << "ms";
+  results.append(result);
+
+  QMetaObject::invokeMethod(imageLoader, &QObject::deleteLater);
+  imageLoaderThread.quit();
+  imageLoaderThread.wait();
+  return results;
+}
+
+QJsonObject preferencesUsed() {
+  return {
+      {"cache_size_mb", Preferences::get(Preferences::SETTING_CACHE_SIZE_MB,
+                                         Preferences::DEFAULT_CACHE_SIZE_MB)
+                            .toInt()},
+      {"prefetch_ahead", Preferences::get(Preferences::SETTING_PREFETCH_AHEAD,
+                                          Preferences::DEFAULT_PREFETCH_AHEAD)
+                             .toInt()},
+      {"prefetch_behind",
+       Preferences::get(Preferences::SETTING_PREFETCH_BEHIND,
+                        Preferences::DEFAULT_PREFETCH_BEHIND)
+           .toInt()},
+      {"screen_resolution_decode",
+       Preferences::get(Preferences::SETTING_SCREEN_RESOLUTION_DECODE, true)
+           .toBool()}};
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  /// Pixmaps need a GUI application, not a screen
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
+  QTemporaryDir root;
+  if (!root.isValid()) {
+    std::fprintf(stderr, "Cannot create a temporary directory\n");
+    return 1;
+  }
+  qputenv("XDG_CACHE_HOME", QFile::encodeName(root.path() + "/cache"));
+
+  QGuiApplication app(argc, argv);
+  QCoreApplication::setApplicationName("ImageViewerBench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Decode, navigation and scan benchmarks");
+  parser.addHelpOption();
+  QCommandLineOption quickOption(
+      "quick", "Smaller datasets, for a quick check rather than numbers");
+  QCommandLineOption repeatOption("repeat", "Runs per measurement.", "N",
+                                  "5");
+  QCommandLineOption outputOption(
+      "output", "Write the JSON results here instead of stdout.", "file");
+  parser.addOptions({quickOption, repeatOption, outputOption});
+  parser.process(app);
+
+  Config config;
+  config.quick = parser.isSet(quickOption);
+  config.repeat = std::max(1, parser.value(repeatOption).toInt());
+  if (config.quick) {
+    config.imageSizes = {QSize(1920, 1280)};
+    config.directorySizes = {1000, 10000};
+    config.navigationImages = 8;
+    config.navigationImageSize = QSize(1920, 1280);
+  } else {
+    config.imageSizes = {QSize(1920, 1280), QSize(4240, 2832),
+                         QSize(6000, 4000)};
+    config.directorySizes = {1000, 10000, 100000};
+    config.navigationImages = 24;
+    config.navigationImageSize = QSize(4240, 2832);
+  }
+
+  QJsonArray results;
+  for (const auto &result : benchScan(config, root.path())) {
+    results.append(result);
+  }
+  for (const auto &result : benchDecode(config, root.path())) {
+    results.append(result);
+  }
+  for (const auto &result : benchNavigation(config, root.path())) {
+    results.append(result);
+  }
+
+  const QJsonObject report{
+      {"benchmark", "ImageViewerBench"},
+      {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+      {"qt_version", qVersion()},
+      {"pixel_kernels", PixelKernels::instructionSet()},
+      {"ideal_thread_count", QThread::idealThreadCount()},
+      {"quick", config.quick},
+      {"repeat", config.repeat},
+      {"preferences", preferencesUsed()},
+      {"results", results}};
+  const QByteArray json = QJsonDocument(report).toJson();
+
+  if (parser.isSet(outputOption)) {
+    QFile output(parser.value(outputOption));
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        output.write(json) != json.size()) {
+      std::fprintf(stderr, "Cannot write %s\n",
+                   qPrintable(parser.value(outputOption)));
+      return 1;
+    }
+  } else {
+    std::fwrite(json.constData(), 1, json.size(), stdout);
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "AnimationPlayer.hpp"
+#include <QImageReader>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include "MappedFile.hpp"
+#include "PixelKernels.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <deque>
+
+namespace {
+
+/// Browsers show frames with no delay, or one too short to be
+/// meant, for 100 ms. Files rely on that
+constexpr int MIN_FRAME_DELAY_MS = 11;
+constexpr int DEFAULT_FRAME_DELAY_MS = 100;
+
+} // namespace
+
+struct AnimationPlayer::Stream {
+  struct Frame {
+    QImage image;
+    qint64 time; // ms after playback started
+  };
+
+  QString imagePath;
+  QSize frameSize;
+
+  QMutex mutex;
+  QWaitCondition spaceFreed;
+  std::deque<Frame> frames;
+  qint64 bytes{0};
+  bool finished{false}; // no more frames will come
+  bool cancelled{false};
+
+  /// Waits for room, false once the player has moved on
+  bool push(Frame frame) {
+    const qint64 frameBytes = frame.image.sizeInBytes();
+    QMutexLocker locker(&mutex);
+    while (!cancelled && !frames.empty() && bytes + frameBytes > RING_BYTES) {
+      spaceFreed.wait(&mutex);
+    }
+    if (cancelled) {
+      return false;
+    }
+    bytes += frameBytes;
+    frames.push_back(std::move(frame));
+    return true;
+  }
+
+  bool isCancelled() {
+    QMutexLocker locker(&mutex);
+    return cancelled;
+  }
+
+  void cancel() {
+    QMutexLocker locker(&mutex);
+    cancelled = true;
+    spaceFreed.wakeAll();
+  }
+
+  void finish() {
+    QMutexLocker locker(&mutex);
+    finished = true;
+  }
+};
+
+AnimationPlayer::AnimationPlayer(QObject *parent) : QObject(parent) {
+  // One decoder plays, the other thread lets it start while the
+  // decoder of the previous animation finishes its last frame
+  m_pool.setMaxThreadCount(2);
+
+  m_timer.setSingleShot(true);
+  m_timer.setTimerType(Qt::PreciseTimer);
+  connect(&m_timer, &QTimer::timeout, this, &AnimationPlayer::onTick);
+}
+
+AnimationPlayer::~AnimationPlayer() {
+  stop();
+  m_pool.waitForDone();
+}
+
+void AnimationPlayer::play(const QString &imagePath, const QSize &frameSize) {
+  stop();
+  if (frameSize.isEmpty()) {
+    return;
+  }
+
+  m_stream = std::make_shared<Stream>();
+  m_stream->imagePath = imagePath;
+  m_stream->frameSize = frameSize;
+  m_framesShown = 0;
+  m_framesDropped = 0;
+
+  m_pool.start([stream = m_stream]() { decode(stream); });
+  m_clock.start();
+  m_timer.start(0);
+}
+
+void AnimationPlayer::stop() {
+  if (!m_stream) {
+    return;
+  }
+
+  m_timer.stop();
+  m_stream->cancel();
+  m_stream.reset();
+
+  if (m_framesShown > 0) {
+    Trace::counter("animation", "frames shown", m_framesShown);
+    Trace::counter("animation", "frames dropped", m_framesDropped);
+  }
+}
+
+void AnimationPlayer::onTick() {
+  if (!m_stream) {
+    return;
+  }
+
+  const qint64 now = m_clock.elapsed();
+  QImage due;
+  int dueCount = 0;
+  qint64 nextTime = -1;
+  bool ended = false;
+  {
+    QMutexLocker locker(&m_stream->mutex);
+    auto &frames = m_stream->frames;
+    while (!frames.empty() && frames.front().time <= now) {
+      due = std::move(frames.front().image);
+      m_stream->bytes -= due.sizeInBytes();
+      frames.pop_front();
+      ++dueCount;
+    }
+    if (dueCount > 0) {
+      m_stream->spaceFreed.wakeAll();
+    }
+    if (!frames.empty()) {
+      nextTime = frames.front().time;
+    }
+    ended = frames.empty() && m_stream->finished;
+  }
+
+  if (dueCount > 0) {
+    // Behind the clock, only the newest due frame is worth drawing
+    m_framesDropped += dueCount - 1;
+    ++m_framesShown;
+    if (dueCount > 1) {
+      Trace::counter("animation", "frames dropped", m_framesDropped);
+    }
+
+    Trace::Span span("convert", "QPixmap::fromImage");
+    emit frameReady(QPixmap::fromImage(due));
+  }
+
+  if (ended) {
+    // The last frame stays up
+    return;
+  }
+  m_timer.start(nextTime < 0
+                    ? STARVED_RETRY_MS
+                    : int(std::max<qint64>(0, nextTime - m_clock.elapsed())));
+}
+
+void AnimationPlayer::decode(const std::shared_ptr<Stream> &stream) {
+  MappedFile mappedFile(stream->imagePath);
+  qint64 time = 0;
+
+  for (int pass = 0;; ++pass) {
+    // Restarting a reader is the only way back to the first frame
+    // that every format supports
+    QImageReader imageReader;
+    if (mappedFile.isValid()) {
+      mappedFile.device()->seek(0);
+      imageReader.setDevice(mappedFile.device());
+    } else {
+      imageReader.setFileName(stream->imagePath);
+    }
+    imageReader.setAllocationLimit(0);
+    imageReader.setAutoTransform(true);
+
+    const bool readerScales =
+        imageReader.supportsOption(QImageIOHandler::ScaledSize);
+    if (readerScales && imageReader.size() != stream->frameSize) {
+      imageReader.setScaledSize(stream->frameSize);
+    }
+
+    int frames = 0;
+    while (!stream->isCancelled()) {
+      Trace::Span span("decode", "animation frame");
+
+      QImage image = imageReader.read();
+      if (image.isNull()) {
+        break;
+      }
+      ++frames;
+
+      if (image.size() != stream->frameSize) {
+        image = PixelKernels::downscale(image, stream->frameSize);
+      }
+
+      // The formats QPixmap takes without converting again
+      image = image.convertToFormat(image.hasAlphaChannel()
+                                        ? QImage::Format_ARGB32_Premultiplied
+                                        : QImage::Format_RGB32);
+
+      const int delay = imageReader.nextImageDelay();
+      if (!stream->push({std::move(image), time})) {
+        return;
+      }
+      time += delay >= MIN_FRAME_DELAY_MS ? delay : DEFAULT_FRAME_DELAY_MS;
+    }
+
+    // loopCount() is -1 for forever, else the repeats after the first pass
+    const int loops = imageReader.loopCount();
+    if (stream->isCancelled() || frames <= 1 ||
+        (loops >= 0 && pass >= loops)) {
+      break;
+    }
+  }
+
+  stream->finish();
+}
\ No newline at end of file
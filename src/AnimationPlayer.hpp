@@ -0,0 +1,56 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPixmap>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <memory>
+
+/// Plays an animated image, e.g. a GIF or an animated WebP, decoding its
+/// frames as playback goes instead of all of them up front.
+///
+/// A worker decodes ahead of the playback clock into a ring of frames
+/// bounded by RING_BYTES rather than by a frame count, and waits while
+/// the ring is full. Memory use does not grow with the length of the
+/// animation, a long 4K capture only ever holds a few frames. A tick that
+/// comes late drops the frames whose time has passed and shows the newest
+/// one that is due, so playback keeps to the clock instead of slowing down.
+class AnimationPlayer : public QObject {
+  Q_OBJECT
+
+  /// Always room for one frame, however large
+  static constexpr inline qint64 RING_BYTES = 192 * 1024 * 1024;
+
+  /// How often to look again while the decoder is behind
+  static constexpr inline int STARVED_RETRY_MS = 4;
+
+  /// Shared with the worker, which may still be finishing a
+  /// frame after the player has moved on
+  struct Stream;
+  std::shared_ptr<Stream> m_stream;
+
+  QThreadPool m_pool;
+  QTimer m_timer;
+  QElapsedTimer m_clock;
+  int m_framesShown{0};
+  int m_framesDropped{0};
+
+public:
+  AnimationPlayer(QObject *parent = nullptr);
+  ~AnimationPlayer();
+
+  /// Frames are decoded at `frameSize`, the size of the
+  /// first frame already on screen
+  void play(const QString &imagePath, const QSize &frameSize);
+  void stop();
+
+signals:
+  void frameReady(const QPixmap &frame);
+
+private:
+  void onTick();
+  static void decode(const std::shared_ptr<Stream> &stream);
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "CachePrewarmer.hpp"
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+
+#include "DecodeOptions.hpp"
+#include "DiskCache.hpp"
+#include "ExifReader.hpp"
+#include "ImageLoader.hpp"
+#include "Trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+/// Files between two progress lines
+constexpr int PROGRESS_EVERY = 500;
+
+bool parseSize(const QString &text, QSize &size) {
+  const auto parts = text.split('x');
+  if (parts.size() != 2) {
+    return false;
+  }
+  bool widthOk = false;
+  bool heightOk = false;
+  size = QSize(parts[0].toInt(&widthOk), parts[1].toInt(&heightOk));
+  return widthOk && heightOk && !size.isEmpty();
+}
+
+} // namespace
+
+bool CachePrewarmer::requested(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--prewarm") == 0 ||
+        std::strncmp(argv[i], "--prewarm=", 10) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+CachePrewarmer::Result CachePrewarmer::prewarmFile(const QString &imagePath,
+                                                   const QSize &proxySize) {
+  Trace::Span span("prewarm", "file", QFileInfo(imagePath).fileName());
+  auto &diskCache = DiskCache::instance();
+
+  const QFileInfo fileInfo(imagePath);
+  const qint64 fileSize = fileInfo.size();
+  const qint64 lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+  /// RAW files show their embedded preview, which needs no proxy
+  const bool raw = ImageLoader::isRaw(imagePath);
+
+  CachedMetadata metadata;
+  if (diskCache.lookup(imagePath, fileSize, lastModified, metadata) &&
+      metadata.width > 0 &&
+      !diskCache.thumbnail(imagePath, fileSize, lastModified).isNull()) {
+    const bool needsProxy = !raw && (metadata.width > proxySize.width() ||
+                                     metadata.height > proxySize.height());
+    if (!needsProxy || diskCache.hasProxy(imagePath, fileSize, lastModified)) {
+      return Result::cached;
+    }
+  }
+
+  DecodeOptions options;
+  options.rawEmbeddedPreview = true;
+  options.targetSize = proxySize;
+
+  QPixmap imagePixmap;
+  const auto imageInfo =
+      ImageLoader::loadImageIntoPixmap(imagePath, options, imagePixmap);
+  if (imagePixmap.isNull()) {
+    return Result::failed;
+  }
+  const QImage image = imagePixmap.toImage();
+
+  const auto exif = ExifReader::read(imagePath);
+  metadata.width = imageInfo.width;
+  metadata.height = imageInfo.height;
+  metadata.orientation = exif.orientation;
+  metadata.captureTime = exif.captureTime;
+  metadata.camera = exif.camera;
+  metadata.sequence = exif.imageNumber;
+
+  /// The thumbnail is reduced from the proxy, sharper than the EXIF one
+  diskCache.store(imagePath, fileSize, lastModified, metadata, image);
+
+  if (imageInfo.isProxy && !raw &&
+      !diskCache.storeProxy(imagePath, fileSize, lastModified, image)) {
+    return Result::failed;
+  }
+  return Result::stored;
+}
+
+int CachePrewarmer::run(const QCoreApplication &application) {
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Fills the disk cache for the given folders without opening a window");
+  parser.addHelpOption();
+  QCommandLineOption prewarmOption(
+      "prewarm", "Folder to cache, may be given more than once.", "dir");
+  QCommandLineOption jobsOption("jobs", "Files decoded in parallel.", "N",
+                                QString::number(QThread::idealThreadCount()));
+  QCommandLineOption proxySizeOption(
+      "proxy-size", "Largest screen the proxies are for.", "WxH",
+      QString("%1x%2").arg(DEFAULT_PROXY_WIDTH).arg(DEFAULT_PROXY_HEIGHT));
+  parser.addOptions({prewarmOption, jobsOption, proxySizeOption});
+  parser.process(application);
+
+  bool jobsOk = false;
+  const int jobs = parser.value(jobsOption).toInt(&jobsOk);
+  if (!jobsOk || jobs < 1) {
+    std::fprintf(stderr, "--jobs needs a positive number\n");
+    return 1;
+  }
+
+  QSize proxySize;
+  if (!parseSize(parser.value(proxySizeOption), proxySize)) {
+    std::fprintf(stderr, "--proxy-size needs a size like 3840x2160\n");
+    return 1;
+  }
+
+  const QStringList directories = parser.values(prewarmOption);
+  for (const auto &directory : directories) {
+    if (!QFileInfo(directory).isDir()) {
+      std::fprintf(stderr, "Not a folder: %s\n", qPrintable(directory));
+      return 1;
+    }
+  }
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(jobs);
+
+  std::atomic<int> done{0};
+  std::atomic<int> stored{0};
+  std::atomic<int> cached{0};
+  std::atomic<int> failed{0};
+
+  QElapsedTimer timer;
+  timer.start();
+
+  /// Files are decoded while the scan goes on, the first batch of
+  /// a scan arrives after a few hundred directory entries
+  const std::atomic<bool> cancelled{false};
+  int files = 0;
+  for (const auto &directory : directories) {
+    qInfo().noquote() << "Scanning" << directory;
+    scanImageFiles(
+        directory, QString(), cancelled,
+        [&](std::vector<QString> batch, bool) {
+          files += int(batch.size());
+          for (auto &imagePath : batch) {
+            pool.start([&, imagePath = std::move(imagePath), proxySize]() {
+              const auto result = prewarmFile(imagePath, proxySize);
+              switch (result) {
+              case Result::cached:
+                ++cached;
+                break;
+              case Result::stored:
+                ++stored;
+                break;
+              case Result::failed:
+                ++failed;
+                qWarning().noquote() << "Could not cache" << imagePath;
+                break;
+              }
+              if (++done % PROGRESS_EVERY == 0) {
+                qInfo() << done.load() << "files done";
+              }
+            });
+          }
+        });
+  }
+  pool.waitForDone();
+
+  qInfo().noquote() << QString("%1 files in %2 s: %3 cached now, %4 were "
+                               "already cached, %5 failed")
+                           .arg(files)
+                           .arg(timer.elapsed() / 1000.0, 0, 'f', 1)
+                           .arg(stored.load())
+                           .arg(cached.load())
+                           .arg(failed.load());
+  return failed.load() > 0 ? 2 : 0;
+}
\ No newline at end of file
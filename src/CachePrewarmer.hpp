@@ -0,0 +1,37 @@
+#pragma once
+#include <QCoreApplication>
+#include <QSize>
+#include <QString>
+
+/// Headless batch mode that fills the disk cache ahead of time, so a
+/// viewer opening the folders later finds every image size, thumbnail
+/// and screen resolution proxy already there.
+///
+///   ImageViewer --prewarm <dir> [--prewarm <dir>...] [--jobs N]
+///               [--proxy-size WxH]
+///
+/// Runs on the offscreen platform and never creates a window. Each file
+/// is decoded once, at the proxy size, and that one decode gives its
+/// dimensions, its thumbnail and its proxy. Files the cache already
+/// covers are skipped, so an interrupted run picks up where it stopped.
+///
+/// Exits with 1 on bad arguments and 2 if any file could not be cached.
+class CachePrewarmer {
+public:
+  /// Proxies are made at this size unless --proxy-size says otherwise.
+  /// Viewers on smaller screens decode the stored proxy at their size
+  static constexpr inline int DEFAULT_PROXY_WIDTH = 3840;
+  static constexpr inline int DEFAULT_PROXY_HEIGHT = 2160;
+
+  /// Checked before the application object exists, the platform
+  /// plugin has to be chosen before then
+  static bool requested(int argc, char *argv[]);
+
+  /// Parses the command line and runs to completion, returns the exit code
+  static int run(const QCoreApplication &application);
+
+private:
+  enum class Result { cached, stored, failed };
+
+  static Result prewarmFile(const QString &imagePath, const QSize &proxySize);
+};
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+#include <QSize>
+#include <QtGlobal>
+
+#include "Preferences.hpp"
+
+/// Settings that change the result of a decode. Two decodes of the
+/// same file with equal options produce the same pixels.
+///
+/// Decodes are handed a copy, a snapshot that settings changed later
+/// leave alone.
+struct DecodeOptions {
+  /// Counts the RAW settings changes the snapshot was taken after.
+  /// Not part of the key, going back to earlier settings makes the
+  /// decodes made with them valid again
+  quint32 version{0};
+
+  bool rawHalfSize{true};
+  bool rawAutoWb{true};
+
+  /// Demosaic to 16 bits per channel instead of 8
+  bool raw16Bit{false};
+
+  /// Decode the JPEG preview embedded in a RAW file
+  /// instead of demosaicing the sensor data
+  bool rawEmbeddedPreview{false};
+
+  /// Decode no larger than this, invalid means full resolution
+  QSize targetSize;
+
+  /// Packed form used in cache keys
+  quint64 key() const {
+    quint64 result = (rawHalfSize ? 1u : 0u) | (rawAutoWb ? 2u : 0u) |
+                     (rawEmbeddedPreview ? 4u : 0u) | (raw16Bit ? 8u : 0u);
+    if (targetSize.isValid()) {
+      result |= (quint64(targetSize.width()) & 0xffffff) << 8;
+      result |= (quint64(targetSize.height()) & 0xffffff) << 32;
+    }
+    return result;
+  }
+
+  /// Same options without the ones that ask for a reduced image
+  DecodeOptions fullResolution() const {
+    DecodeOptions options = *this;
+    options.rawEmbeddedPreview = false;
+    options.targetSize = QSize();
+    return options;
+  }
+
+  static DecodeOptions fromPreferences() {
+    DecodeOptions options;
+    options.rawHalfSize =
+        Preferences::get(Preferences::SETTING_RAW_HALF_SIZE, true).toBool();
+    options.rawAutoWb =
+        Preferences::get(Preferences::SETTING_RAW_AUTO_WB, true).toBool();
+    options.raw16Bit =
+        Preferences::get(Preferences::SETTING_RAW_16_BIT, false).toBool();
+    return options;
+  }
+};
\ No newline at end of file
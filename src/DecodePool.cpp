@@ -0,0 +1,40 @@
+#include "DecodePool.hpp"
+
+DecodePool::DecodePool(int maxThreads) {
+  m_pool.setMaxThreadCount(maxThreads);
+}
+
+DecodePool::~DecodePool() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+quint64 DecodePool::advanceGeneration() { return ++m_generation; }
+
+DecodePool::Ticket DecodePool::makeTicket() const {
+  return std::make_shared<std::atomic<quint64>>(m_generation.load());
+}
+
+void DecodePool::renew(const Ticket &ticket) const {
+  ticket->store(m_generation.load());
+}
+
+bool DecodePool::isStale(const Ticket &ticket) const {
+  return ticket->load() < m_generation.load();
+}
+
+void DecodePool::submit(const Ticket &ticket, int priority, Job job,
+                        Job dropped) {
+  m_pool.start(
+      [this, ticket, job = std::move(job), dropped = std::move(dropped)]() {
+        if (isStale(ticket)) {
+          /// User has already moved on, skip the decode
+          if (dropped) {
+            dropped();
+          }
+          return;
+        }
+        job();
+      },
+      priority);
+}
\ No newline at end of file
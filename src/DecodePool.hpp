@@ -0,0 +1,37 @@
+#pragma once
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/// Pool of worker threads that image decodes run on.
+///
+/// Every navigation step in ImageLoader advances the pool's generation.
+/// Each submitted job holds a ticket with the generation it was last
+/// requested in. When a worker picks up a job whose ticket is older than
+/// the current generation, the user has already navigated past that image
+/// and the job is dropped before any decoding happens.
+class DecodePool {
+public:
+  using Ticket = std::shared_ptr<std::atomic<quint64>>;
+  using Job = std::function<void()>;
+
+  explicit DecodePool(int maxThreads = QThread::idealThreadCount());
+  ~DecodePool();
+
+  quint64 advanceGeneration();
+  Ticket makeTicket() const;
+  void renew(const Ticket &ticket) const;
+  bool isStale(const Ticket &ticket) const;
+
+  /// Queue `job` to run on a worker. If the ticket has gone stale by the
+  /// time a worker is free, `dropped` runs instead.
+  void submit(const Ticket &ticket, int priority, Job job, Job dropped);
+
+private:
+  QThreadPool m_pool;
+  std::atomic<quint64> m_generation{0};
+};
\ No newline at end of file
@@ -0,0 +1,601 @@
+#include "DiskCache.hpp"
+#include "PixelKernels.hpp"
+#include <QBuffer>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr char INDEX_MAGIC[8] = {'I', 'V', 'C', 'A', 'C', 'H', 'E', '1'};
+constexpr quint32 INDEX_VERSION = 2; // 2 added camera and sequence
+constexpr quint64 INITIAL_CAPACITY = 4096;
+constexpr int THUMBNAIL_QUALITY = 85;
+constexpr int PROXY_QUALITY = 90;
+
+/// The mapping is shared with other processes, which change
+/// the generation while this one reads from it
+quint32 loadGeneration(const quint32 &generation) {
+  const quint32 value = *static_cast<const volatile quint32 *>(&generation);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return value;
+}
+
+void storeGeneration(quint32 &generation, quint32 value) {
+  std::atomic_thread_fence(std::memory_order_release);
+  *static_cast<volatile quint32 *>(&generation) = value;
+}
+
+/// Renames over an existing file in one step, unlike QFile::rename
+bool replaceFile(const QString &from, const QString &to) {
+  return std::rename(QFile::encodeName(from).constData(),
+                     QFile::encodeName(to).constData()) == 0;
+}
+} // namespace
+
+struct DiskCache::Header {
+  char magic[8];
+  quint32 version;
+  quint32 retired; // replaced by a larger table, remap
+  quint64 capacity; // number of records, a power of two
+  quint64 count;
+  quint32 thumbnailGeneration; // odd while thumbnails.bin is compacted
+  char reserved[28];
+};
+
+struct DiskCache::Record {
+  quint64 pathHash; // 0 marks an empty slot
+  qint64 fileSize;
+  qint64 lastModified;
+  qint32 width;
+  qint32 height;
+  qint32 orientation;
+  quint32 sequence;
+  qint64 captureTime;
+  quint64 thumbnailOffset;
+  quint32 thumbnailSize;
+  quint32 proxyStored; // a proxy file for this version of the file exists
+  char camera[32]; // UTF-8, not terminated when it fills the array
+};
+
+DiskCache &DiskCache::instance() {
+  static DiskCache cache;
+  return cache;
+}
+
+DiskCache::DiskCache() {
+  m_directory =
+      QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+      "/p-ranav/ImageViewer";
+  QDir().mkpath(m_directory + "/proxies");
+
+  m_thumbnailFile.setFileName(m_directory + "/thumbnails.bin");
+}
+
+DiskCache::~DiskCache() {
+  if (m_mapping) {
+    m_indexFile.unmap(m_mapping);
+  }
+}
+
+quint64 DiskCache::hashPath(const QString &path) {
+  // FNV-1a, stable across runs and Qt versions unlike qHash
+  quint64 hash = 14695981039346656037ull;
+  for (char c : path.toUtf8()) {
+    hash ^= static_cast<uchar>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+QString DiskCache::proxyPath(quint64 pathHash) const {
+  return m_directory + "/proxies/" + QString::number(pathHash, 16) + ".jpg";
+}
+
+QByteArray DiskCache::encodeThumbnail(const QImage &thumbnail) {
+  QByteArray encoded;
+  QBuffer buffer(&encoded);
+  buffer.open(QIODevice::WriteOnly);
+  const QSize size = thumbnail.size().boundedTo(thumbnail.size().scaled(
+      THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio));
+  PixelKernels::downscale(thumbnail, size)
+      .save(&buffer, "JPG", THUMBNAIL_QUALITY);
+  return encoded;
+}
+
+bool DiskCache::createIndex(QFile &file, quint64 capacity) {
+  static_assert(sizeof(Header) == 64, "index header layout");
+  static_assert(sizeof(Record) == 96, "index record layout");
+
+  Header header{};
+  std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = INDEX_VERSION;
+  header.capacity = capacity;
+
+  // resize() zero fills, which marks every record empty
+  return file.resize(0) &&
+         file.resize(sizeof(Header) + capacity * sizeof(Record)) &&
+         file.seek(0) &&
+         file.write(reinterpret_cast<const char *>(&header), sizeof(header)) ==
+             qint64(sizeof(header)) &&
+         file.flush();
+}
+
+bool DiskCache::mapIndex(bool locked) {
+  if (m_mapping) {
+    m_indexFile.unmap(m_mapping);
+    m_mapping = nullptr;
+  }
+  m_indexFile.close();
+
+  m_indexFile.setFileName(m_directory + "/index.bin");
+  if (!m_indexFile.open(QIODevice::ReadWrite)) {
+    return false;
+  }
+
+  auto valid = [this]() {
+    if (m_indexFile.size() < qint64(sizeof(Header))) {
+      return false;
+    }
+    Header header;
+    m_indexFile.seek(0);
+    if (m_indexFile.read(reinterpret_cast<char *>(&header), sizeof(header)) !=
+        qint64(sizeof(header))) {
+      return false;
+    }
+    return std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+           header.version == INDEX_VERSION && header.retired == 0 &&
+           header.capacity > 0 &&
+           (header.capacity & (header.capacity - 1)) == 0 &&
+           m_indexFile.size() ==
+               qint64(sizeof(Header) + header.capacity * sizeof(Record));
+  };
+
+  if (!valid()) {
+    // Missing, from an older version or damaged. Start over
+    QLockFile lock(m_directory + "/index.lock");
+    if (!locked) {
+      lock.lock();
+    }
+
+    // Another process may have put a new index in place meanwhile
+    m_indexFile.close();
+    if (!m_indexFile.open(QIODevice::ReadWrite)) {
+      return false;
+    }
+    if (!valid() && !createIndex(m_indexFile, INITIAL_CAPACITY)) {
+      return false;
+    }
+  }
+
+  m_mapping = m_indexFile.map(0, m_indexFile.size());
+  return m_mapping != nullptr;
+}
+
+bool DiskCache::ensureMapped(bool locked) {
+  if (m_mapping &&
+      reinterpret_cast<const Header *>(m_mapping)->retired == 0) {
+    return true;
+  }
+  return mapIndex(locked);
+}
+
+DiskCache::Record *DiskCache::find(quint64 pathHash) {
+  auto *header = reinterpret_cast<Header *>(m_mapping);
+  auto *records = reinterpret_cast<Record *>(m_mapping + sizeof(Header));
+  const quint64 mask = header->capacity - 1;
+
+  // Linear probing, stops at the matching record or the first empty one
+  for (quint64 i = 0; i < header->capacity; ++i) {
+    auto *record = &records[(pathHash + i) & mask];
+    if (record->pathHash == pathHash || record->pathHash == 0) {
+      return record;
+    }
+  }
+  return nullptr;
+}
+
+bool DiskCache::lookup(const QString &path, qint64 fileSize,
+                       qint64 lastModified, CachedMetadata &metadata) {
+  QMutexLocker locker(&m_mutex);
+  if (!ensureMapped()) {
+    return false;
+  }
+
+  const auto pathHash = hashPath(path);
+  const auto *record = find(pathHash);
+  if (!record || record->pathHash != pathHash ||
+      record->fileSize != fileSize || record->lastModified != lastModified) {
+    return false;
+  }
+
+  metadata.width = record->width;
+  metadata.height = record->height;
+  metadata.orientation = record->orientation;
+  metadata.captureTime = record->captureTime;
+  metadata.camera = QString::fromUtf8(
+      record->camera,
+      qsizetype(qstrnlen(record->camera, sizeof(record->camera))));
+  metadata.sequence = record->sequence;
+  return true;
+}
+
+QImage DiskCache::thumbnail(const QString &path, qint64 fileSize,
+                            qint64 lastModified) {
+  QMutexLocker locker(&m_mutex);
+  if (!ensureMapped()) {
+    return {};
+  }
+
+  // Reads without index.lock. A compaction in another process moves
+  // the blobs, so the read only counts if the generation stayed put
+  auto &generation = reinterpret_cast<Header *>(m_mapping)->thumbnailGeneration;
+  const quint32 before = loadGeneration(generation);
+  if (before % 2 != 0) {
+    return {};
+  }
+  if (before != m_thumbnailGeneration) {
+    // Opened before a compaction replaced the file
+    m_thumbnailFile.close();
+    m_thumbnailGeneration = before;
+  }
+
+  const auto pathHash = hashPath(path);
+  const auto *record = find(pathHash);
+  if (!record || record->pathHash != pathHash ||
+      record->fileSize != fileSize || record->lastModified != lastModified ||
+      record->thumbnailSize == 0) {
+    return {};
+  }
+  const quint64 thumbnailOffset = record->thumbnailOffset;
+  const quint32 thumbnailSize = record->thumbnailSize;
+
+  if (!m_thumbnailFile.isOpen() && !m_thumbnailFile.open(QIODevice::ReadOnly)) {
+    return {};
+  }
+  if (!m_thumbnailFile.seek(thumbnailOffset)) {
+    return {};
+  }
+  const QByteArray encoded = m_thumbnailFile.read(thumbnailSize);
+  if (loadGeneration(generation) != before) {
+    return {};
+  }
+  return QImage::fromData(encoded, "JPG");
+}
+
+bool DiskCache::grow() {
+  const auto *oldHeader = reinterpret_cast<const Header *>(m_mapping);
+  const auto *oldRecords =
+      reinterpret_cast<const Record *>(m_mapping + sizeof(Header));
+  const quint64 capacity = oldHeader->capacity * 2;
+
+  const QString indexPath = m_directory + "/index.bin";
+  const QString newIndexPath = indexPath + ".new";
+
+  QFile newIndex(newIndexPath);
+  if (!newIndex.open(QIODevice::ReadWrite) ||
+      !createIndex(newIndex, capacity)) {
+    return false;
+  }
+
+  uchar *newMapping = newIndex.map(0, newIndex.size());
+  if (!newMapping) {
+    return false;
+  }
+
+  auto *newHeader = reinterpret_cast<Header *>(newMapping);
+  auto *newRecords = reinterpret_cast<Record *>(newMapping + sizeof(Header));
+  for (quint64 i = 0; i < oldHeader->capacity; ++i) {
+    const auto &record = oldRecords[i];
+    if (record.pathHash == 0) {
+      continue;
+    }
+    for (quint64 j = 0; j < capacity; ++j) {
+      auto &slot = newRecords[(record.pathHash + j) & (capacity - 1)];
+      if (slot.pathHash == 0) {
+        slot = record;
+        ++newHeader->count;
+        break;
+      }
+    }
+  }
+  newHeader->thumbnailGeneration = oldHeader->thumbnailGeneration;
+  newIndex.unmap(newMapping);
+  newIndex.close();
+
+  // index.bin is never missing, a process opening it
+  // gets either the old table or the new one
+  if (!replaceFile(newIndexPath, indexPath)) {
+    QFile::remove(newIndexPath);
+    return false;
+  }
+
+  // Other processes still have the old table mapped. Marking it
+  // retired makes them pick up the new one on their next access
+  reinterpret_cast<Header *>(m_mapping)->retired = 1;
+  m_indexFile.unmap(m_mapping);
+  m_mapping = nullptr;
+  m_indexFile.close();
+  return mapIndex(true);
+}
+
+void DiskCache::compactThumbnails() {
+  auto *header = reinterpret_cast<Header *>(m_mapping);
+  auto *records = reinterpret_cast<Record *>(m_mapping + sizeof(Header));
+  const QString thumbnailPath = m_directory + "/thumbnails.bin";
+
+  QFile oldFile(thumbnailPath);
+  QSaveFile newFile(thumbnailPath);
+  if (!oldFile.open(QIODevice::ReadOnly) ||
+      !newFile.open(QIODevice::WriteOnly)) {
+    return;
+  }
+
+  // Blobs of files that changed or were stored again are left behind.
+  // Past half the cap the rest are dropped, and made again when shown
+  struct Moved {
+    Record *record;
+    quint64 offset;
+    quint32 size;
+  };
+  std::vector<Moved> moved;
+  quint64 written = 0;
+  for (quint64 i = 0; i < header->capacity; ++i) {
+    auto &record = records[i];
+    if (record.pathHash == 0 || record.thumbnailSize == 0 ||
+        written + record.thumbnailSize > quint64(MAX_THUMBNAIL_BYTES / 2) ||
+        !oldFile.seek(record.thumbnailOffset)) {
+      continue;
+    }
+    const QByteArray encoded = oldFile.read(record.thumbnailSize);
+    if (encoded.size() != qsizetype(record.thumbnailSize) ||
+        newFile.write(encoded) != encoded.size()) {
+      continue;
+    }
+    moved.push_back({&record, written, record.thumbnailSize});
+    written += record.thumbnailSize;
+  }
+
+  // Readers in other processes see an odd generation and skip
+  // reading until the records point into the new file
+  const quint32 generation = header->thumbnailGeneration;
+  storeGeneration(header->thumbnailGeneration, generation + 1);
+  if (!newFile.commit()) {
+    storeGeneration(header->thumbnailGeneration, generation + 2);
+    return;
+  }
+  for (quint64 i = 0; i < header->capacity; ++i) {
+    records[i].thumbnailOffset = 0;
+    records[i].thumbnailSize = 0;
+  }
+  for (const auto &blob : moved) {
+    blob.record->thumbnailOffset = blob.offset;
+    blob.record->thumbnailSize = blob.size;
+  }
+  storeGeneration(header->thumbnailGeneration, generation + 2);
+  m_thumbnailFile.close();
+}
+
+void DiskCache::trimProxies() {
+  QDir proxies(m_directory + "/proxies");
+  const auto files = proxies.entryInfoList(
+      {"*.jpg"}, QDir::Files, QDir::Time | QDir::Reversed); // oldest first
+
+  qint64 total = 0;
+  for (const auto &file : files) {
+    total += file.size();
+  }
+
+  for (const auto &file : files) {
+    if (total <= MAX_PROXY_BYTES / 10 * 9) {
+      break;
+    }
+
+    // Unflagged first, a reader that still finds
+    // the flag then finds no file and decodes
+    bool ok = false;
+    const quint64 pathHash = file.completeBaseName().toULongLong(&ok, 16);
+    auto *record = ok ? find(pathHash) : nullptr;
+    if (record && record->pathHash == pathHash) {
+      record->proxyStored = 0;
+    }
+    if (QFile::remove(file.filePath())) {
+      total -= file.size();
+    }
+  }
+  m_proxyBytes = total;
+}
+
+void DiskCache::store(const QString &path, qint64 fileSize,
+                      qint64 lastModified, const CachedMetadata &metadata,
+                      const QImage &thumbnail) {
+  // Encoded before taking the locks, which the other writers wait on
+  const QByteArray encoded =
+      thumbnail.isNull() ? QByteArray() : encodeThumbnail(thumbnail);
+
+  QMutexLocker locker(&m_mutex);
+
+  QLockFile lock(m_directory + "/index.lock");
+  if (!lock.tryLock(100)) {
+    // Another process is writing, this entry can wait for next time
+    return;
+  }
+
+  if (!ensureMapped(true)) {
+    return;
+  }
+  writeRecord(path, fileSize, lastModified, metadata, encoded);
+}
+
+void DiskCache::storeMetadata(const std::vector<Entry> &entries) {
+  if (entries.empty()) {
+    return;
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  QLockFile lock(m_directory + "/index.lock");
+  if (!lock.tryLock(100)) {
+    return;
+  }
+
+  if (!ensureMapped(true)) {
+    return;
+  }
+  for (const auto &entry : entries) {
+    if (!writeRecord(entry.path, entry.fileSize, entry.lastModified,
+                     entry.metadata, QByteArray())) {
+      return;
+    }
+  }
+}
+
+bool DiskCache::writeRecord(const QString &path, qint64 fileSize,
+                            qint64 lastModified,
+                            const CachedMetadata &metadata,
+                            const QByteArray &encoded) {
+  // Keep the load factor under one half so probes stay short
+  auto *header = reinterpret_cast<Header *>(m_mapping);
+  if ((header->count + 1) * 2 > header->capacity && !grow()) {
+    return false;
+  }
+  header = reinterpret_cast<Header *>(m_mapping);
+
+  const auto pathHash = hashPath(path);
+  auto *record = find(pathHash);
+  if (!record) {
+    return false;
+  }
+
+  const bool sameFile = record->pathHash == pathHash &&
+                        record->fileSize == fileSize &&
+                        record->lastModified == lastModified;
+
+  quint64 thumbnailOffset = 0;
+  quint32 thumbnailSize = 0;
+  if (!encoded.isEmpty()) {
+    const QString thumbnailPath = m_directory + "/thumbnails.bin";
+    if (QFileInfo(thumbnailPath).size() + encoded.size() >
+        MAX_THUMBNAIL_BYTES) {
+      compactThumbnails();
+    }
+
+    m_thumbnailFile.close();
+    if (m_thumbnailFile.open(QIODevice::ReadWrite | QIODevice::Append)) {
+      thumbnailOffset = m_thumbnailFile.size();
+      if (m_thumbnailFile.write(encoded) == encoded.size()) {
+        thumbnailSize = encoded.size();
+      }
+      m_thumbnailFile.close();
+    }
+  } else if (sameFile) {
+    thumbnailOffset = record->thumbnailOffset;
+    thumbnailSize = record->thumbnailSize;
+  }
+
+  const bool newRecord = record->pathHash == 0;
+  if (!sameFile && record->pathHash == pathHash && record->proxyStored) {
+    // Made from the previous version of the file
+    QFile::remove(proxyPath(pathHash));
+  }
+
+  record->fileSize = fileSize;
+  record->lastModified = lastModified;
+  record->width = metadata.width;
+  record->height = metadata.height;
+  record->orientation = metadata.orientation;
+  record->captureTime = metadata.captureTime;
+  const QByteArray camera = metadata.camera.toUtf8();
+  std::memset(record->camera, 0, sizeof(record->camera));
+  std::memcpy(record->camera, camera.constData(),
+              std::min(sizeof(record->camera), size_t(camera.size())));
+  record->sequence = metadata.sequence;
+  record->thumbnailOffset = thumbnailOffset;
+  record->thumbnailSize = thumbnailSize;
+  record->proxyStored = sameFile ? record->proxyStored : 0;
+  record->pathHash = pathHash;
+
+  if (newRecord) {
+    ++header->count;
+  }
+  return true;
+}
+
+bool DiskCache::hasProxy(const QString &path, qint64 fileSize,
+                         qint64 lastModified) {
+  QMutexLocker locker(&m_mutex);
+  if (!ensureMapped()) {
+    return false;
+  }
+
+  const auto pathHash = hashPath(path);
+  const auto *record = find(pathHash);
+  return record && record->pathHash == pathHash &&
+         record->fileSize == fileSize &&
+         record->lastModified == lastModified && record->proxyStored != 0;
+}
+
+QImage DiskCache::proxy(const QString &path, qint64 fileSize,
+                        qint64 lastModified, const QSize &size) {
+  if (!hasProxy(path, fileSize, lastModified)) {
+    return {};
+  }
+
+  // Proxy files are replaced by renaming, so reading needs no lock
+  QImageReader reader(proxyPath(hashPath(path)));
+  const QSize stored = reader.size();
+
+  // One pixel short is rounding, not a smaller proxy
+  if (!stored.isValid() || stored.width() + 1 < size.width() ||
+      stored.height() + 1 < size.height()) {
+    return {};
+  }
+  if (stored.width() > size.width() || stored.height() > size.height()) {
+    reader.setScaledSize(size);
+  }
+  return reader.read();
+}
+
+bool DiskCache::storeProxy(const QString &path, qint64 fileSize,
+                           qint64 lastModified, const QImage &proxy) {
+  const auto pathHash = hashPath(path);
+
+  // Encoded before taking the locks, which the other writers wait on
+  QSaveFile file(proxyPath(pathHash));
+  if (proxy.isNull() || !file.open(QIODevice::WriteOnly) ||
+      !proxy.save(&file, "JPG", PROXY_QUALITY) || !file.commit()) {
+    return false;
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  QLockFile lock(m_directory + "/index.lock");
+  if (!lock.tryLock(100) || !ensureMapped(true)) {
+    return false;
+  }
+
+  auto *record = find(pathHash);
+  if (!record || record->pathHash != pathHash ||
+      record->fileSize != fileSize || record->lastModified != lastModified) {
+    return false;
+  }
+  record->proxyStored = 1;
+
+  // Measured once, then counted up until it passes the cap
+  if (m_proxyBytes >= 0) {
+    m_proxyBytes += QFileInfo(proxyPath(pathHash)).size();
+  }
+  if (m_proxyBytes < 0 || m_proxyBytes > MAX_PROXY_BYTES) {
+    trimProxies();
+  }
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include <cstdint>
+#include <vector>
+
+/// What the disk cache knows about one file
+struct CachedMetadata {
+  /// 0 until a decode, entries made for sorting only hold the EXIF data
+  int width{0};
+  int height{0};
+  int orientation{1};
+  qint64 captureTime{0};
+  QString camera;
+  quint32 sequence{0}; // EXIF ImageNumber
+};
+
+/// Persistent cache of image metadata and thumbnails, shared between runs
+/// and between processes.
+///
+/// Lives under the XDG cache directory. The index is a memory-mapped open
+/// addressing hash table of fixed-size records keyed by a hash of the path
+/// and validated against the file's size and modification time, so a
+/// lookup is a few memory reads with nothing to parse on startup.
+/// Thumbnails are JPEG blobs appended to a second file. Screen resolution
+/// proxies, written by a pre-warm, are JPEG files of their own.
+///
+/// Both are capped. Past MAX_THUMBNAIL_BYTES the thumbnail file is
+/// rewritten with only the blobs records still point to, and at most half
+/// of the cap of those. Past MAX_PROXY_BYTES the oldest proxies go.
+///
+/// Writes from several processes are serialized with a lock file. When
+/// the table fills up it is rebuilt at twice the size into a new file and
+/// the old one is marked retired, so other processes remap it.
+class DiskCache {
+public:
+  static constexpr inline int THUMBNAIL_SIZE = 256;
+  static constexpr inline qint64 MAX_THUMBNAIL_BYTES = 1024LL * 1024 * 1024;
+  static constexpr inline qint64 MAX_PROXY_BYTES = 16LL * 1024 * 1024 * 1024;
+
+  /// One file's metadata, for storing many at once
+  struct Entry {
+    QString path;
+    qint64 fileSize{0};
+    qint64 lastModified{0};
+    CachedMetadata metadata;
+  };
+
+  static DiskCache &instance();
+
+  bool lookup(const QString &path, qint64 fileSize, qint64 lastModified,
+              CachedMetadata &metadata);
+  QImage thumbnail(const QString &path, qint64 fileSize, qint64 lastModified);
+
+  /// A null thumbnail keeps the one already stored, if any
+  void store(const QString &path, qint64 fileSize, qint64 lastModified,
+             const CachedMetadata &metadata, const QImage &thumbnail);
+
+  /// Like store() with null thumbnails, under one acquisition of the locks
+  void storeMetadata(const std::vector<Entry> &entries);
+
+  /// The stored proxy decoded at `size`, null if there is none or it is
+  /// smaller than that
+  QImage proxy(const QString &path, qint64 fileSize, qint64 lastModified,
+               const QSize &size);
+  bool hasProxy(const QString &path, qint64 fileSize, qint64 lastModified);
+
+  /// Needs the entry made by store() for the same file version
+  bool storeProxy(const QString &path, qint64 fileSize, qint64 lastModified,
+                  const QImage &proxy);
+
+  QString directory() const { return m_directory; }
+
+private:
+  struct Header;
+  struct Record;
+
+  DiskCache();
+  ~DiskCache();
+
+  static quint64 hashPath(const QString &path);
+  QString proxyPath(quint64 pathHash) const;
+  static QByteArray encodeThumbnail(const QImage &thumbnail);
+  static bool createIndex(QFile &file, quint64 capacity);
+
+  /// `locked` when the caller holds index.lock already
+  bool mapIndex(bool locked);
+  bool ensureMapped(bool locked = false);
+  Record *find(quint64 pathHash);
+
+  /// These need index.lock
+  bool writeRecord(const QString &path, qint64 fileSize, qint64 lastModified,
+                   const CachedMetadata &metadata, const QByteArray &encoded);
+  bool grow();
+  void compactThumbnails();
+  void trimProxies();
+
+  QString m_directory;
+  QFile m_indexFile;
+  QFile m_thumbnailFile;
+  quint32 m_thumbnailGeneration{0}; // of the file m_thumbnailFile has open
+  qint64 m_proxyBytes{-1}; // -1 until measured
+  uchar *m_mapping{nullptr};
+  QMutex m_mutex;
+};
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include "ExifReader.hpp"
+#include <QFile>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr quint16 TAG_MAKE = 0x010F;
+constexpr quint16 TAG_MODEL = 0x0110;
+constexpr quint16 TAG_ORIENTATION = 0x0112;
+constexpr quint16 TAG_EXIF_IFD = 0x8769;
+constexpr quint16 TAG_JPEG_INTERCHANGE_FORMAT = 0x0201;
+constexpr quint16 TAG_JPEG_INTERCHANGE_FORMAT_LENGTH = 0x0202;
+constexpr quint16 TAG_DATE_TIME_ORIGINAL = 0x9003;
+constexpr quint16 TAG_IMAGE_NUMBER = 0x9211;
+constexpr quint16 TAG_SUB_SEC_TIME_ORIGINAL = 0x9291;
+
+constexpr quint16 TYPE_ASCII = 2;
+constexpr quint16 TYPE_SHORT = 3;
+
+/// Bounds-checked view of the TIFF structure inside the header bytes
+class TiffView {
+  const uchar *m_data;
+  qsizetype m_size;
+  bool m_bigEndian;
+
+public:
+  TiffView(const uchar *data, qsizetype size, bool bigEndian)
+      : m_data(data), m_size(size), m_bigEndian(bigEndian) {}
+
+  bool contains(quint64 offset, quint64 length) const {
+    return offset <= quint64(m_size) && length <= quint64(m_size) - offset;
+  }
+
+  quint16 u16(quint64 offset) const {
+    if (!contains(offset, 2)) {
+      return 0;
+    }
+    const uchar *p = m_data + offset;
+    return m_bigEndian ? quint16((p[0] << 8) | p[1])
+                       : quint16((p[1] << 8) | p[0]);
+  }
+
+  quint32 u32(quint64 offset) const {
+    if (!contains(offset, 4)) {
+      return 0;
+    }
+    const uchar *p = m_data + offset;
+    return m_bigEndian ? (quint32(p[0]) << 24) | (quint32(p[1]) << 16) |
+                             (quint32(p[2]) << 8) | quint32(p[3])
+                       : (quint32(p[3]) << 24) | (quint32(p[2]) << 16) |
+                             (quint32(p[1]) << 8) | quint32(p[0]);
+  }
+
+  /// ASCII value of an IFD entry, stored inline when 4 bytes or less
+  QByteArray ascii(quint64 entry) const {
+    if (u16(entry + 2) != TYPE_ASCII) {
+      return {};
+    }
+    const quint32 count = u32(entry + 4);
+    const quint64 offset = count <= 4 ? entry + 8 : u32(entry + 8);
+    if (!contains(offset, count)) {
+      return {};
+    }
+    const char *p = reinterpret_cast<const char *>(m_data + offset);
+    return QByteArray(p, qsizetype(strnlen(p, count)));
+  }
+
+  /// Integer value of an IFD entry, SHORT or LONG
+  quint32 integer(quint64 entry) const {
+    return u16(entry + 2) == TYPE_SHORT ? u16(entry + 8) : u32(entry + 8);
+  }
+
+  /// Calls fn(tag, entryOffset) for every entry of the IFD at offset
+  template <typename Function>
+  void forEachEntry(quint64 offset, Function fn) const {
+    const quint16 count = u16(offset);
+    if (!contains(offset + 2, quint64(count) * 12)) {
+      return;
+    }
+    for (quint16 i = 0; i < count; ++i) {
+      const quint64 entry = offset + 2 + quint64(i) * 12;
+      fn(u16(entry), entry);
+    }
+  }
+
+  /// Offset of the IFD chained after the one at offset, 0 at the end
+  quint32 nextIfd(quint64 offset) const {
+    return u32(offset + 2 + quint64(u16(offset)) * 12);
+  }
+
+  QByteArray bytes(quint64 offset, quint64 length) const {
+    if (length == 0 || !contains(offset, length)) {
+      return {};
+    }
+    return QByteArray(reinterpret_cast<const char *>(m_data + offset),
+                      qsizetype(length));
+  }
+};
+
+/// Days since 1970-01-01 of a proleptic Gregorian date
+qint64 daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  const qint64 era = (year >= 0 ? year : year - 399) / 400;
+  const qint64 yearOfEra = year - era * 400;
+  const qint64 dayOfYear =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const qint64 dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+/// "YYYY:MM:DD HH:MM:SS" plus optional sub-second digits
+qint64 parseDateTime(const QByteArray &dateTime, const QByteArray &subSec) {
+  int year, month, day, hour, minute, second;
+  if (dateTime.size() < 19 ||
+      std::sscanf(dateTime.constData(), "%4d:%2d:%2d %2d:%2d:%2d", &year,
+                  &month, &day, &hour, &minute, &second) != 6 ||
+      year <= 0 || month < 1 || month > 12 || day < 1 || day > 31) {
+    return 0;
+  }
+
+  // First three digits are milliseconds
+  int milliseconds = 0;
+  int scale = 100;
+  for (int i = 0; i < subSec.size() && scale > 0; ++i) {
+    if (subSec[i] < '0' || subSec[i] > '9') {
+      break;
+    }
+    milliseconds += (subSec[i] - '0') * scale;
+    scale /= 10;
+  }
+
+  const qint64 seconds = daysFromCivil(year, month, day) * 86400 +
+                         hour * 3600 + minute * 60 + second;
+  return seconds * 1000 + milliseconds;
+}
+
+/// The model alone when it starts with the brand, as "Canon EOS R5"
+/// does, else the first word of the make in front of it
+QString cameraName(const QByteArray &make, const QByteArray &model) {
+  const QString brand = QString::fromLatin1(make).trimmed().section(' ', 0, 0);
+  const QString name = QString::fromLatin1(model).trimmed();
+  if (name.isEmpty()) {
+    return brand;
+  }
+  if (brand.isEmpty() || name.startsWith(brand, Qt::CaseInsensitive)) {
+    return name;
+  }
+  return brand + ' ' + name;
+}
+
+ExifData parseTiff(const uchar *data, qsizetype size) {
+  ExifData result;
+  if (size < 8) {
+    return result;
+  }
+
+  // II for little endian, MM for big endian. The magic number that
+  // follows differs between TIFF and the RAW formats built on it
+  bool bigEndian;
+  if (data[0] == 'I' && data[1] == 'I') {
+    bigEndian = false;
+  } else if (data[0] == 'M' && data[1] == 'M') {
+    bigEndian = true;
+  } else {
+    return result;
+  }
+
+  TiffView tiff(data, size, bigEndian);
+
+  const quint32 ifd0 = tiff.u32(4);
+  quint32 exifIfd = 0;
+  QByteArray make;
+  QByteArray model;
+  tiff.forEachEntry(ifd0, [&](quint16 tag, quint64 entry) {
+    if (tag == TAG_MAKE) {
+      make = tiff.ascii(entry);
+    } else if (tag == TAG_MODEL) {
+      model = tiff.ascii(entry);
+    } else if (tag == TAG_ORIENTATION) {
+      const int orientation = tiff.u16(entry + 8);
+      if (orientation >= 1 && orientation <= 8) {
+        result.orientation = orientation;
+      }
+    } else if (tag == TAG_EXIF_IFD) {
+      exifIfd = tiff.u32(entry + 8);
+    }
+  });
+  result.camera = cameraName(make, model);
+
+  if (exifIfd != 0) {
+    QByteArray dateTime;
+    QByteArray subSec;
+    tiff.forEachEntry(exifIfd, [&](quint16 tag, quint64 entry) {
+      if (tag == TAG_DATE_TIME_ORIGINAL) {
+        dateTime = tiff.ascii(entry);
+      } else if (tag == TAG_SUB_SEC_TIME_ORIGINAL) {
+        subSec = tiff.ascii(entry);
+      } else if (tag == TAG_IMAGE_NUMBER) {
+        result.imageNumber = tiff.integer(entry);
+      }
+    });
+    result.captureTime = parseDateTime(dateTime, subSec);
+  }
+
+  // IFD1 describes the thumbnail, JPEG compressed in practice
+  const quint32 ifd1 = tiff.nextIfd(ifd0);
+  if (ifd1 != 0) {
+    quint32 thumbnailOffset = 0;
+    quint32 thumbnailLength = 0;
+    tiff.forEachEntry(ifd1, [&](quint16 tag, quint64 entry) {
+      if (tag == TAG_JPEG_INTERCHANGE_FORMAT) {
+        thumbnailOffset = tiff.u32(entry + 8);
+      } else if (tag == TAG_JPEG_INTERCHANGE_FORMAT_LENGTH) {
+        thumbnailLength = tiff.u32(entry + 8);
+      }
+    });
+    result.thumbnail = tiff.bytes(thumbnailOffset, thumbnailLength);
+  }
+
+  return result;
+}
+
+} // namespace
+
+ExifData ExifReader::read(const QString &imagePath) {
+  QFile file(imagePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return {};
+  }
+  return parse(file.read(HEADER_BYTES));
+}
+
+ExifData ExifReader::readTags(const QString &imagePath) {
+  QFile file(imagePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return {};
+  }
+
+  QByteArray data = file.read(TAG_BYTES);
+  auto result = parse(data);
+
+  // Some cameras write the maker note first, the capture
+  // time then comes later in the header
+  const bool hasExif =
+      data.startsWith("\xFF\xD8") || data.startsWith("II") ||
+      data.startsWith("MM");
+  if (result.captureTime == 0 && hasExif && data.size() == TAG_BYTES) {
+    data += file.read(HEADER_BYTES - TAG_BYTES);
+    result = parse(data);
+  }
+
+  result.thumbnail.clear();
+  return result;
+}
+
+ExifData ExifReader::parse(const QByteArray &data) {
+  const auto *bytes = reinterpret_cast<const uchar *>(data.constData());
+  const qsizetype size = data.size();
+
+  if (size < 4) {
+    return {};
+  }
+
+  if (bytes[0] != 0xFF || bytes[1] != 0xD8) {
+    // Not a JPEG, try TIFF based formats
+    return parseTiff(bytes, size);
+  }
+
+  // Walk the JPEG segments up to the start of the image data
+  qsizetype offset = 2;
+  while (offset + 4 <= size && bytes[offset] == 0xFF) {
+    const uchar marker = bytes[offset + 1];
+    const qsizetype length = (bytes[offset + 2] << 8) | bytes[offset + 3];
+    if (marker == 0xDA || length < 2) {
+      break;
+    }
+
+    // APP1 with the "Exif\0\0" identifier wraps a TIFF structure
+    if (marker == 0xE1 && offset + 10 <= size &&
+        std::memcmp(bytes + offset + 4, "Exif\0\0", 6) == 0) {
+      const qsizetype tiffStart = offset + 10;
+      const qsizetype tiffEnd = std::min(size, offset + 2 + length);
+      return parseTiff(bytes + tiffStart, tiffEnd - tiffStart);
+    }
+
+    offset += 2 + length;
+  }
+
+  return {};
+}
\ No newline at end of file
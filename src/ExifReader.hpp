@@ -0,0 +1,44 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+
+/// Metadata read from the EXIF block at the start of an image file
+struct ExifData {
+  /// EXIF orientation, 1 is upright
+  int orientation{1};
+
+  /// DateTimeOriginal with sub-seconds, as milliseconds since the epoch
+  /// of the camera's wall clock. 0 when unknown
+  qint64 captureTime{0};
+
+  /// Make and model, e.g. "Canon EOS R5" or "SONY ILCE-7RM4".
+  /// Empty when unknown
+  QString camera;
+
+  /// ImageNumber, the camera's shot counter where it records one
+  quint32 imageNumber{0};
+
+  /// JPEG thumbnail from IFD1, empty when there is none
+  QByteArray thumbnail;
+};
+
+/// Minimal EXIF parser that only looks at the first few KB of a file.
+///
+/// Understands JPEG (APP1 Exif segment) and TIFF based files, which covers
+/// TIFF itself and most RAW formats (NEF, CR2, ARW, DNG, ORF, RW2, PEF).
+/// Anything outside the header bytes is treated as missing.
+class ExifReader {
+public:
+  static constexpr inline qint64 HEADER_BYTES = 64 * 1024;
+
+  /// The tags up to the Exif IFD usually sit in this much of a file,
+  /// before the maker note and the thumbnail
+  static constexpr inline qint64 TAG_BYTES = 16 * 1024;
+
+  static ExifData read(const QString &imagePath);
+
+  /// Everything but the thumbnail, reading as little as it can
+  static ExifData readTags(const QString &imagePath);
+
+  static ExifData parse(const QByteArray &data);
+};
\ No newline at end of file
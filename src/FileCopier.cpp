@@ -0,0 +1,252 @@
+#include "FileCopier.hpp"
+#include <QFile>
+#include <QFileDevice>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "Trace.hpp"
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+FileCopier::FileCopier(QObject *parent) : QObject(parent) {
+  // One at a time, parallel copies to one disk only seek more
+  m_pool.setMaxThreadCount(1);
+}
+
+FileCopier::~FileCopier() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+FileCopier::CancelFlag FileCopier::copy(const QString &source,
+                                        const QString &destination) {
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+
+  m_pool.start([this, source, destination, cancelled]() {
+    Trace::Span span("io", "copy file", QFileInfo(source).fileName());
+    QString errorString;
+    // Cleans up after itself, the destination is only
+    // replaced once the copy is complete
+    const bool success =
+        copyFile(source, destination, *cancelled, errorString);
+    emit finished(destination, success, errorString);
+  });
+
+  return cancelled;
+}
+
+#ifdef Q_OS_LINUX
+
+bool FileCopier::copyFile(const QString &source, const QString &destination,
+                          const std::atomic<bool> &cancelled,
+                          QString &errorString) {
+  auto fail = [&errorString](const char *what) {
+    errorString = QString("%1: %2").arg(what).arg(std::strerror(errno));
+    return false;
+  };
+
+  const int in = ::open(QFile::encodeName(source).constData(),
+                        O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    return fail("Cannot open source");
+  }
+
+  struct stat status;
+  if (::fstat(in, &status) != 0) {
+    ::close(in);
+    return fail("Cannot read source");
+  }
+
+  // "Copy to..." suggests the last folder, which may be the source's
+  struct stat existing;
+  const QByteArray destinationName = QFile::encodeName(destination);
+  if (::stat(destinationName.constData(), &existing) == 0 &&
+      existing.st_dev == status.st_dev && existing.st_ino == status.st_ino) {
+    ::close(in);
+    errorString = "Source and destination are the same file";
+    return false;
+  }
+
+  // Written next to the destination and renamed over it when complete,
+  // a failed or cancelled copy leaves any file already there untouched
+  const QFileInfo destinationInfo(destination);
+  QByteArray temporaryName = QFile::encodeName(
+      destinationInfo.path() + "/." + destinationInfo.fileName() + ".XXXXXX");
+  const int out = ::mkostemp(temporaryName.data(), O_CLOEXEC);
+  if (out < 0) {
+    ::close(in);
+    return fail("Cannot open destination");
+  }
+  ::fchmod(out, status.st_mode & 0777);
+
+  const qint64 total = status.st_size;
+  qint64 copied = 0;
+  bool success = true;
+
+  // Shares the source's blocks where the filesystem supports it
+  // (btrfs, XFS, bcachefs, ...), no data is copied at all
+  if (::ioctl(out, FICLONE, in) == 0) {
+    copied = total;
+  }
+
+  enum class Method { CopyFileRange, SendFile, ReadWrite };
+  Method method = Method::CopyFileRange;
+  std::vector<char> buffer;
+
+  while (copied < total) {
+    if (cancelled) {
+      errorString = "Cancelled";
+      success = false;
+      break;
+    }
+
+    const auto chunk =
+        static_cast<size_t>(std::min(CHUNK_BYTES, total - copied));
+    ssize_t written = -1;
+
+    if (method == Method::CopyFileRange) {
+      written = ::copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+      if (written < 0 && (errno == ENOSYS || errno == EXDEV ||
+                          errno == EINVAL || errno == EOPNOTSUPP)) {
+        // Older kernel or a pair of filesystems it cannot
+        // copy between. Continue from the same offsets
+        method = Method::SendFile;
+        continue;
+      }
+    } else if (method == Method::SendFile) {
+      written = ::sendfile(out, in, nullptr, chunk);
+      if (written < 0 && (errno == ENOSYS || errno == EINVAL)) {
+        method = Method::ReadWrite;
+        continue;
+      }
+    } else {
+      buffer.resize(BUFFER_BYTES);
+      const ssize_t bytesRead = ::read(
+          in, buffer.data(), std::min<size_t>(chunk, buffer.size()));
+      written = bytesRead;
+      for (ssize_t offset = 0; offset < bytesRead;) {
+        const ssize_t n =
+            ::write(out, buffer.data() + offset, bytesRead - offset);
+        if (n < 0) {
+          written = -1;
+          break;
+        }
+        offset += n;
+      }
+    }
+
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("Copy failed");
+      success = false;
+      break;
+    }
+    if (written == 0) {
+      // The source got shorter while copying
+      break;
+    }
+
+    copied += written;
+    emit progress(destination, copied, total);
+  }
+
+  if (success) {
+    emit progress(destination, total, total);
+  }
+
+  if (::close(out) != 0 && success) {
+    fail("Cannot write destination");
+    success = false;
+  }
+  ::close(in);
+
+  if (success &&
+      ::rename(temporaryName.constData(), destinationName.constData()) != 0) {
+    fail("Cannot write destination");
+    success = false;
+  }
+  if (!success) {
+    ::unlink(temporaryName.constData());
+  }
+  return success;
+}
+
+#else
+
+bool FileCopier::copyFile(const QString &source, const QString &destination,
+                          const std::atomic<bool> &cancelled,
+                          QString &errorString) {
+  QFile in(source);
+  if (!in.open(QIODevice::ReadOnly)) {
+    errorString = in.errorString();
+    return false;
+  }
+
+  // "Copy to..." suggests the last folder, which may be the source's
+  const QString canonicalSource = QFileInfo(source).canonicalFilePath();
+  if (!canonicalSource.isEmpty() &&
+      canonicalSource == QFileInfo(destination).canonicalFilePath()) {
+    errorString = "Source and destination are the same file";
+    return false;
+  }
+
+  // Replaces the destination only on commit(), a failed or
+  // cancelled copy leaves any file already there untouched
+  QSaveFile out(destination);
+  if (!out.open(QIODevice::WriteOnly)) {
+    errorString = out.errorString();
+    return false;
+  }
+
+  const qint64 total = in.size();
+  qint64 copied = 0;
+  std::vector<char> buffer(BUFFER_BYTES);
+
+  while (copied < total) {
+    if (cancelled) {
+      errorString = "Cancelled";
+      return false;
+    }
+
+    const qint64 bytesRead = in.read(buffer.data(), buffer.size());
+    if (bytesRead < 0) {
+      errorString = in.errorString();
+      return false;
+    }
+    if (bytesRead == 0) {
+      break;
+    }
+    if (out.write(buffer.data(), bytesRead) != bytesRead) {
+      errorString = out.errorString();
+      return false;
+    }
+
+    copied += bytesRead;
+    if (copied % CHUNK_BYTES < bytesRead || copied == total) {
+      emit progress(destination, copied, total);
+    }
+  }
+
+  if (!out.commit()) {
+    errorString = out.errorString();
+    return false;
+  }
+  return true;
+}
+
+#endif
\ No newline at end of file
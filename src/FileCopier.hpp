@@ -0,0 +1,46 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+
+/// Copies files on a background thread, reporting progress.
+///
+/// On Linux the data never passes through user space: the copy is first
+/// tried as a reflink (FICLONE), which shares blocks on filesystems that
+/// support it and finishes instantly, then with copy_file_range, which
+/// can also copy server-side on NFS and SMB, then with sendfile. Other
+/// platforms and filesystems where none of those apply copy in fixed
+/// size chunks, so memory use never depends on the file size.
+class FileCopier : public QObject {
+  Q_OBJECT
+
+  /// Progress is reported after each chunk
+  static constexpr inline qint64 CHUNK_BYTES = 64 * 1024 * 1024;
+  static constexpr inline qint64 BUFFER_BYTES = 4 * 1024 * 1024;
+
+  QThreadPool m_pool;
+
+public:
+  using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+
+  explicit FileCopier(QObject *parent = nullptr);
+  ~FileCopier();
+
+  /// Queues the copy. Setting the returned flag cancels it. The data goes
+  /// to a temporary file renamed to the destination once complete, so a
+  /// failed or cancelled copy leaves the destination as it was
+  CancelFlag copy(const QString &source, const QString &destination);
+
+signals:
+  void progress(const QString &destination, qint64 copiedBytes,
+                qint64 totalBytes);
+  void finished(const QString &destination, bool success,
+                const QString &errorString);
+
+private:
+  bool copyFile(const QString &source, const QString &destination,
+                const std::atomic<bool> &cancelled, QString &errorString);
+};
\ No newline at end of file
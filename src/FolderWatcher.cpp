@@ -0,0 +1,176 @@
+#include "FolderWatcher.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::FolderWatcher(QObject *parent) : QObject(parent) {}
+
+FolderWatcher::~FolderWatcher() { stop(); }
+
+#ifdef Q_OS_LINUX
+
+void FolderWatcher::watch(const QString &directory) {
+  stop();
+
+  m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotifyFd < 0) {
+    qWarning() << "inotify_init1 failed, folder updates are off";
+    return;
+  }
+
+  // Written files are picked up once closed, so a camera
+  // still writing a frame does not show half of it
+  if (inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE |
+                            IN_MOVED_FROM) < 0) {
+    qWarning() << "Cannot watch" << directory;
+    stop();
+    return;
+  }
+
+  m_directory = directory;
+  m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+  connect(m_notifier, &QSocketNotifier::activated, this,
+          &FolderWatcher::readEvents);
+}
+
+void FolderWatcher::stop() {
+  delete m_notifier;
+  m_notifier = nullptr;
+
+  if (m_inotifyFd >= 0) {
+    ::close(m_inotifyFd);
+    m_inotifyFd = -1;
+  }
+  m_directory.clear();
+}
+
+void FolderWatcher::readEvents() {
+  QStringList written;
+  QStringList removed;
+  QStringList renamedFrom;
+  QStringList renamedTo;
+
+  // The kernel queues both halves of a rename together, so
+  // an old name left unpaired here was moved out of the folder
+  QHash<quint32, QString> movedFrom; // by cookie
+
+  alignas(inotify_event) char buffer[16 * 1024];
+  for (;;) {
+    const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break;
+    }
+
+    for (ssize_t offset = 0; offset < length;) {
+      const auto *event =
+          reinterpret_cast<const inotify_event *>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        qWarning() << "Too many changes in" << m_directory
+                   << "some were missed";
+        continue;
+      }
+      if (event->len == 0 || (event->mask & IN_ISDIR)) {
+        continue;
+      }
+
+      const auto path = m_directory + '/' + QFile::decodeName(event->name);
+      if (event->mask & IN_MOVED_FROM) {
+        movedFrom.insert(event->cookie, path);
+      } else if ((event->mask & IN_MOVED_TO) &&
+                 movedFrom.contains(event->cookie)) {
+        renamedFrom.append(movedFrom.take(event->cookie));
+        renamedTo.append(path);
+      } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        written.append(path);
+      } else if (event->mask & IN_DELETE) {
+        // Removals are applied first, so a file written
+        // and then removed here only counts as removed
+        written.removeAll(path);
+        removed.append(path);
+      }
+    }
+  }
+
+  for (const auto &path : std::as_const(movedFrom)) {
+    written.removeAll(path);
+    removed.append(path);
+  }
+
+  if (!removed.isEmpty()) {
+    emit filesRemoved(removed);
+  }
+  if (!renamedFrom.isEmpty()) {
+    emit filesRenamed(renamedFrom, renamedTo);
+  }
+  if (!written.isEmpty()) {
+    written.removeDuplicates();
+    emit filesWritten(written);
+  }
+}
+
+#else
+
+void FolderWatcher::watch(const QString &directory) {
+  stop();
+
+  m_directory = directory;
+  m_listing = listDirectory();
+
+  m_watcher = new QFileSystemWatcher({directory}, this);
+  connect(m_watcher, &QFileSystemWatcher::directoryChanged, this,
+          &FolderWatcher::compareListing);
+}
+
+void FolderWatcher::stop() {
+  delete m_watcher;
+  m_watcher = nullptr;
+  m_listing.clear();
+  m_directory.clear();
+}
+
+QHash<QString, qint64> FolderWatcher::listDirectory() const {
+  QHash<QString, qint64> listing;
+  const auto entries = QDir(m_directory).entryInfoList(QDir::Files);
+  for (const auto &entry : entries) {
+    listing.insert(entry.absoluteFilePath(),
+                   entry.lastModified().toMSecsSinceEpoch());
+  }
+  return listing;
+}
+
+void FolderWatcher::compareListing() {
+  auto listing = listDirectory();
+
+  QStringList written;
+  QStringList removed;
+  for (auto it = listing.cbegin(); it != listing.cend(); ++it) {
+    auto previous = m_listing.find(it.key());
+    if (previous == m_listing.end() || previous.value() != it.value()) {
+      written.append(it.key());
+    }
+  }
+  for (auto it = m_listing.cbegin(); it != m_listing.cend(); ++it) {
+    if (!listing.contains(it.key())) {
+      removed.append(it.key());
+    }
+  }
+  m_listing = std::move(listing);
+
+  if (!removed.isEmpty()) {
+    emit filesRemoved(removed);
+  }
+  if (!written.isEmpty()) {
+    emit filesWritten(written);
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QString>
+#include <QStringList>
+
+/// Reports files written to, moved into, deleted from or moved out of
+/// one directory, so the open folder can be updated by deltas instead of
+/// being listed again.
+///
+/// On Linux this reads inotify events directly, which name the files
+/// involved. Elsewhere it falls back to QFileSystemWatcher, which only
+/// says that the directory changed, and finds the files by comparing a
+/// listing against the previous one.
+///
+/// A file replaced in place is reported as written. On Linux a rename
+/// within the directory is reported as one, its two inotify events are
+/// paired by their cookie. Elsewhere it shows up as a removal of the old
+/// name and a write of the new one.
+class FolderWatcher : public QObject {
+  Q_OBJECT
+
+  QString m_directory;
+
+#ifdef Q_OS_LINUX
+  int m_inotifyFd{-1};
+  QSocketNotifier *m_notifier{nullptr};
+
+  void readEvents();
+#else
+  QFileSystemWatcher *m_watcher{nullptr};
+  QHash<QString, qint64> m_listing; // path to mtime in ms
+
+  QHash<QString, qint64> listDirectory() const;
+  void compareListing();
+#endif
+
+public:
+  explicit FolderWatcher(QObject *parent = nullptr);
+  ~FolderWatcher();
+
+  /// Replaces any directory watched before
+  void watch(const QString &directory);
+  void stop();
+
+signals:
+  void filesWritten(const QStringList &paths);
+  void filesRemoved(const QStringList &paths);
+  /// `from[i]` is now called `to[i]`
+  void filesRenamed(const QStringList &from, const QStringList &to);
+};
\ No newline at end of file
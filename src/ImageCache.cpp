@@ -0,0 +1,77 @@
+#include "ImageCache.hpp"
+
+ImageCache::ImageCache(qint64 budgetBytes) : m_budgetBytes(budgetBytes) {}
+
+void ImageCache::setBudget(qint64 budgetBytes) {
+  m_budgetBytes = budgetBytes;
+  evict();
+}
+
+const ImageCache::Entry *ImageCache::find(const ImageCacheKey &key) {
+  auto it = m_index.constFind(key);
+  if (it == m_index.constEnd()) {
+    return nullptr;
+  }
+
+  // Move to the front of the LRU list
+  m_entries.splice(m_entries.begin(), m_entries, it.value());
+  return &m_entries.front();
+}
+
+bool ImageCache::contains(const ImageCacheKey &key) const {
+  return m_index.contains(key);
+}
+
+void ImageCache::insert(const ImageCacheKey &key, const QPixmap &pixmap,
+                        const ImageInfo &info) {
+  auto it = m_index.constFind(key);
+  if (it != m_index.constEnd()) {
+    m_usedBytes -= it.value()->bytes;
+    m_entries.erase(it.value());
+    m_index.remove(key);
+  }
+
+  const auto bytes = bytesFor(pixmap);
+  if (bytes > m_budgetBytes) {
+    /// Would evict everything else and still not fit
+    return;
+  }
+
+  m_entries.push_front({key, pixmap, info, bytes});
+  m_index.insert(key, m_entries.begin());
+  m_usedBytes += bytes;
+
+  evict();
+}
+
+void ImageCache::remove(const QString &path) {
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->key.path == path) {
+      m_usedBytes -= it->bytes;
+      m_index.remove(it->key);
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ImageCache::clear() {
+  m_entries.clear();
+  m_index.clear();
+  m_usedBytes = 0;
+}
+
+qint64 ImageCache::bytesFor(const QPixmap &pixmap) {
+  return static_cast<qint64>(pixmap.width()) * pixmap.height() *
+         pixmap.depth() / 8;
+}
+
+void ImageCache::evict() {
+  while (m_usedBytes > m_budgetBytes && !m_entries.empty()) {
+    const auto &last = m_entries.back();
+    m_usedBytes -= last.bytes;
+    m_index.remove(last.key);
+    m_entries.pop_back();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <QHash>
+#include <QHashFunctions>
+#include <QPixmap>
+#include <QString>
+
+#include "ImageInfo.hpp"
+
+#include <list>
+
+struct ImageCacheKey {
+  QString path;
+  qint64 lastModified{0};
+  quint64 options{0};
+
+  bool operator==(const ImageCacheKey &other) const {
+    return path == other.path && lastModified == other.lastModified &&
+           options == other.options;
+  }
+  bool operator!=(const ImageCacheKey &other) const {
+    return !(*this == other);
+  }
+};
+
+inline size_t qHash(const ImageCacheKey &key, size_t seed = 0) {
+  return qHashMulti(seed, key.path, key.lastModified, key.options);
+}
+
+/// Least-recently-used cache of decoded images, bounded by the
+/// number of bytes the pixmaps occupy rather than by image count.
+class ImageCache {
+public:
+  struct Entry {
+    ImageCacheKey key;
+    QPixmap pixmap;
+    ImageInfo info;
+    qint64 bytes{0};
+  };
+
+  explicit ImageCache(qint64 budgetBytes = 0);
+
+  void setBudget(qint64 budgetBytes);
+  qint64 budget() const { return m_budgetBytes; }
+  qint64 usedBytes() const { return m_usedBytes; }
+
+  /// Returns nullptr on a miss. A hit becomes the most recently used entry.
+  const Entry *find(const ImageCacheKey &key);
+  bool contains(const ImageCacheKey &key) const;
+  void insert(const ImageCacheKey &key, const QPixmap &pixmap,
+              const ImageInfo &info);
+
+  /// Drop every cached variant of this file
+  void remove(const QString &path);
+  void clear();
+
+  static qint64 bytesFor(const QPixmap &pixmap);
+
+private:
+  void evict();
+
+  qint64 m_budgetBytes{0};
+  qint64 m_usedBytes{0};
+
+  /// Front is most recently used
+  std::list<Entry> m_entries;
+  QHash<ImageCacheKey, std::list<Entry>::iterator> m_index;
+};
\ No newline at end of file
@@ -0,0 +1,401 @@
+#include "ImageFileIndex.hpp"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+
+#include "ExifReader.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+/// Run fn(begin, end) over [0, count) split across the available cores
+template <typename Function>
+void parallelFor(std::size_t count, std::size_t minimumPerThread,
+                 Function fn) {
+  const std::size_t threads = std::clamp<std::size_t>(
+      count / std::max<std::size_t>(minimumPerThread, 1), 1,
+      static_cast<std::size_t>(QThread::idealThreadCount()));
+
+  if (threads == 1) {
+    fn(std::size_t{0}, count);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  const std::size_t chunk = (count + threads - 1) / threads;
+  for (std::size_t begin = 0; begin < count; begin += chunk) {
+    const std::size_t end = std::min(begin + chunk, count);
+    workers.emplace_back([&fn, begin, end]() { fn(begin, end); });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+/// Stable sort, split into sorted runs on several threads
+/// which are then merged pairwise, also in parallel
+template <typename Compare>
+void parallelStableSort(std::vector<std::uint32_t> &order, Compare compare) {
+  const std::size_t threads =
+      static_cast<std::size_t>(QThread::idealThreadCount());
+  if (order.size() < ImageFileIndex::PARALLEL_SORT_THRESHOLD ||
+      threads <= 1) {
+    std::stable_sort(order.begin(), order.end(), compare);
+    return;
+  }
+
+  const std::size_t chunk = (order.size() + threads - 1) / threads;
+  std::vector<std::size_t> bounds;
+  for (std::size_t begin = 0; begin < order.size(); begin += chunk) {
+    bounds.push_back(begin);
+  }
+  bounds.push_back(order.size());
+  const std::size_t runs = bounds.size() - 1;
+
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < runs; ++i) {
+    workers.emplace_back([&, i]() {
+      std::stable_sort(order.begin() + bounds[i], order.begin() + bounds[i + 1],
+                       compare);
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (std::size_t width = 1; width < runs; width *= 2) {
+    workers.clear();
+    for (std::size_t i = 0; i + width < runs; i += 2 * width) {
+      const auto first = bounds[i];
+      const auto middle = bounds[i + width];
+      const auto last = bounds[std::min(i + 2 * width, runs)];
+      workers.emplace_back([&, first, middle, last]() {
+        std::inplace_merge(order.begin() + first, order.begin() + middle,
+                           order.begin() + last, compare);
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+}
+
+} // namespace
+
+void ImageFileIndex::assign(const std::vector<QString> &paths) {
+  m_paths = paths;
+  m_sizes.assign(paths.size(), 0);
+  m_lastModified.assign(paths.size(), 0);
+  m_nameKeys.assign(paths.size(), QString());
+  m_metadata.assign(paths.size(), CachedMetadata{});
+  m_metadataKnown.assign(paths.size(), 0);
+
+  /// One stat per file, spread over the cores since on network
+  /// filesystems each one is a round trip
+  parallelFor(paths.size(), 64, [this](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      QFileInfo fileInfo(m_paths[i]);
+      m_sizes[i] = fileInfo.size();
+      m_lastModified[i] = fileInfo.lastModified().toMSecsSinceEpoch();
+      m_nameKeys[i] = m_paths[i].toCaseFolded();
+      m_metadataKnown[i] = DiskCache::instance().lookup(
+          m_paths[i], m_sizes[i], m_lastModified[i], m_metadata[i]);
+    }
+  });
+
+  rebuildLookup();
+}
+
+void ImageFileIndex::clear() {
+  m_paths.clear();
+  m_sizes.clear();
+  m_lastModified.clear();
+  m_nameKeys.clear();
+  m_metadata.clear();
+  m_metadataKnown.clear();
+  rebuildLookup();
+}
+
+void ImageFileIndex::rebuildLookup() {
+  m_slotByPath.clear();
+  m_slotByPath.reserve(static_cast<qsizetype>(m_paths.size()));
+  for (std::size_t slot = 0; slot < m_paths.size(); ++slot) {
+    m_slotByPath.insert(m_paths[slot], static_cast<std::uint32_t>(slot));
+  }
+
+  /// Every slot is live, so each node covers its full range
+  m_liveSlots.assign(m_paths.size() + 1, 0);
+  for (std::size_t i = 1; i < m_liveSlots.size(); ++i) {
+    m_liveSlots[i] = static_cast<std::int32_t>(i & (~i + 1));
+  }
+  m_dead.assign(m_paths.size(), false);
+  m_deadSlots = 0;
+}
+
+std::size_t ImageFileIndex::slotAt(std::size_t index) const {
+  if (m_deadSlots == 0) {
+    return index;
+  }
+
+  /// Descend the tree for the (index + 1)-th live slot
+  std::size_t slot = 0;
+  auto remaining = static_cast<std::int32_t>(index + 1);
+  std::size_t step = 1;
+  while (step * 2 < m_liveSlots.size()) {
+    step *= 2;
+  }
+  for (; step > 0; step /= 2) {
+    if (slot + step < m_liveSlots.size() &&
+        m_liveSlots[slot + step] < remaining) {
+      slot += step;
+      remaining -= m_liveSlots[slot];
+    }
+  }
+  return slot;
+}
+
+std::size_t ImageFileIndex::indexOfSlot(std::size_t slot) const {
+  if (m_deadSlots == 0) {
+    return slot;
+  }
+
+  /// Live slots before this one
+  std::int32_t before = 0;
+  for (auto i = slot; i > 0; i -= i & (~i + 1)) {
+    before += m_liveSlots[i];
+  }
+  return static_cast<std::size_t>(before);
+}
+
+void ImageFileIndex::removeSlot(std::size_t slot) {
+  m_slotByPath.remove(m_paths[slot]);
+  m_dead[slot] = true;
+  ++m_deadSlots;
+  for (auto i = slot + 1; i < m_liveSlots.size(); i += i & (~i + 1)) {
+    m_liveSlots[i] -= 1;
+  }
+}
+
+void ImageFileIndex::compact() {
+  if (m_deadSlots == 0) {
+    return;
+  }
+
+  auto compactValues = [this](auto &values) {
+    std::size_t kept = 0;
+    for (std::size_t slot = 0; slot < values.size(); ++slot) {
+      if (!m_dead[slot]) {
+        if (kept != slot) {
+          values[kept] = std::move(values[slot]);
+        }
+        ++kept;
+      }
+    }
+    values.resize(kept);
+  };
+
+  compactValues(m_paths);
+  compactValues(m_sizes);
+  compactValues(m_lastModified);
+  compactValues(m_nameKeys);
+  compactValues(m_metadata);
+  compactValues(m_metadataKnown);
+  rebuildLookup();
+}
+
+template <typename Function>
+void ImageFileIndex::withSortKeys(SortBy by, Function fn) const {
+  if (by == SortBy::size) {
+    fn(m_sizes);
+  } else if (by == SortBy::date_modified) {
+    fn(m_lastModified);
+  } else if (sortsByMetadata(by)) {
+    /// Files without a capture time go by their modification time.
+    /// Frames of a burst can share a capture time to the millisecond,
+    /// the camera's image number orders those
+    auto captureTime = [this](std::size_t slot) {
+      const qint64 time = m_metadata[slot].captureTime;
+      return time != 0 ? time : m_lastModified[slot];
+    };
+    if (by == SortBy::capture_time) {
+      std::vector<std::tuple<qint64, QString, quint32>> keys;
+      keys.reserve(m_paths.size());
+      for (std::size_t slot = 0; slot < m_paths.size(); ++slot) {
+        keys.emplace_back(captureTime(slot), m_metadata[slot].camera,
+                          m_metadata[slot].sequence);
+      }
+      fn(keys);
+    } else {
+      std::vector<std::tuple<QString, qint64, quint32>> keys;
+      keys.reserve(m_paths.size());
+      for (std::size_t slot = 0; slot < m_paths.size(); ++slot) {
+        keys.emplace_back(m_metadata[slot].camera, captureTime(slot),
+                          m_metadata[slot].sequence);
+      }
+      fn(keys);
+    }
+  } else {
+    fn(m_nameKeys);
+  }
+}
+
+void ImageFileIndex::readMetadata() {
+  std::vector<std::size_t> missing;
+  for (std::size_t slot = 0; slot < m_paths.size(); ++slot) {
+    if (!m_metadataKnown[slot] && !m_dead[slot]) {
+      missing.push_back(slot);
+    }
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  Trace::Span span("index", "read metadata");
+
+  /// A few KB of header per file. Like the stats, each read is a
+  /// round trip on network filesystems and they overlap on threads
+  parallelFor(missing.size(), 16, [&](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      const auto slot = missing[i];
+      const auto exif = ExifReader::readTags(m_paths[slot]);
+      auto &metadata = m_metadata[slot];
+      metadata.orientation = exif.orientation;
+      metadata.captureTime = exif.captureTime;
+      metadata.camera = exif.camera;
+      metadata.sequence = exif.imageNumber;
+      m_metadataKnown[slot] = 1;
+    }
+  });
+
+  /// All in one go rather than from each worker, which would
+  /// take the cache's locks once per file. No thumbnail yet,
+  /// and the size waits for the first decode
+  std::vector<DiskCache::Entry> entries;
+  entries.reserve(missing.size());
+  for (const auto slot : missing) {
+    entries.push_back(
+        {m_paths[slot], m_sizes[slot], m_lastModified[slot], m_metadata[slot]});
+  }
+  DiskCache::instance().storeMetadata(entries);
+}
+
+void ImageFileIndex::sort(SortBy by, SortOrder order) {
+  Trace::Span span("index", "sort");
+  compact();
+  if (sortsByMetadata(by)) {
+    readMetadata();
+  }
+
+  std::vector<std::uint32_t> permutation(m_paths.size());
+  std::iota(permutation.begin(), permutation.end(), 0);
+
+  /// Descending by the flipped comparison rather than by reversing,
+  /// so files with equal keys keep their order either way
+  const bool descending = order == SortOrder::descending;
+  withSortKeys(by, [&](const auto &keys) {
+    parallelStableSort(permutation,
+                       [&keys, descending](std::uint32_t a, std::uint32_t b) {
+                         return descending ? keys[b] < keys[a]
+                                           : keys[a] < keys[b];
+                       });
+  });
+
+  applyOrder(permutation);
+}
+
+void ImageFileIndex::merge(ImageFileIndex batch, SortBy by, SortOrder order) {
+  Trace::Span span("index", "merge");
+
+  /// Files already listed, e.g. added by a folder
+  /// change while the scan was running
+  for (std::size_t slot = 0; slot < batch.m_paths.size(); ++slot) {
+    if (!batch.m_dead[slot] && contains(batch.m_paths[slot])) {
+      batch.removeSlot(slot);
+    }
+  }
+  if (batch.empty()) {
+    return;
+  }
+  batch.sort(by, order);
+  compact();
+  if (sortsByMetadata(by)) {
+    /// The list may hold files added before there was an order
+    /// by these keys, e.g. the image it was opened with
+    readMetadata();
+  }
+
+  const auto existing = m_paths.size();
+  append(std::move(batch));
+
+  std::vector<std::uint32_t> permutation(m_paths.size());
+  std::iota(permutation.begin(), permutation.end(), 0);
+
+  const bool descending = order == SortOrder::descending;
+  withSortKeys(by, [&](const auto &keys) {
+    std::inplace_merge(permutation.begin(), permutation.begin() + existing,
+                       permutation.end(),
+                       [&keys, descending](std::uint32_t a, std::uint32_t b) {
+                         return descending ? keys[b] < keys[a]
+                                           : keys[a] < keys[b];
+                       });
+  });
+
+  applyOrder(permutation);
+}
+
+std::optional<std::size_t> ImageFileIndex::indexOf(const QString &path) const {
+  auto it = m_slotByPath.find(path);
+  if (it == m_slotByPath.end()) {
+    return std::nullopt;
+  }
+  return indexOfSlot(it.value());
+}
+
+void ImageFileIndex::remove(std::size_t index) {
+  removeSlot(slotAt(index));
+
+  /// Keep the dead from outweighing the living
+  if (m_deadSlots * 2 > m_paths.size()) {
+    compact();
+  }
+}
+
+void ImageFileIndex::append(ImageFileIndex &&other) {
+  auto append = [](auto &values, auto &otherValues) {
+    values.insert(values.end(), std::make_move_iterator(otherValues.begin()),
+                  std::make_move_iterator(otherValues.end()));
+  };
+
+  append(m_paths, other.m_paths);
+  append(m_sizes, other.m_sizes);
+  append(m_lastModified, other.m_lastModified);
+  append(m_nameKeys, other.m_nameKeys);
+  append(m_metadata, other.m_metadata);
+  append(m_metadataKnown, other.m_metadataKnown);
+  other.clear();
+  rebuildLookup();
+}
+
+void ImageFileIndex::applyOrder(const std::vector<std::uint32_t> &order) {
+  auto reorder = [&order](auto &values) {
+    std::remove_reference_t<decltype(values)> sorted;
+    sorted.reserve(values.size());
+    for (auto i : order) {
+      sorted.push_back(std::move(values[i]));
+    }
+    values = std::move(sorted);
+  };
+
+  reorder(m_paths);
+  reorder(m_sizes);
+  reorder(m_lastModified);
+  reorder(m_nameKeys);
+  reorder(m_metadata);
+  reorder(m_metadataKnown);
+  rebuildLookup();
+}
\ No newline at end of file
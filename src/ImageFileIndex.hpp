@@ -0,0 +1,112 @@
+#pragma once
+#include <QHash>
+#include <QString>
+
+#include "DiskCache.hpp"
+#include "SortOptions.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/// The image files of the open directory, in display order.
+///
+/// Kept as a struct of arrays: each file is stat-ed once when added and
+/// its sort keys (size, modification time and a case-folded collation key
+/// for the name) are stored next to the path, so sorting never touches
+/// the filesystem. Dimensions and EXIF data come from the DiskCache
+/// when an earlier run has seen the file. Sorting by capture time or
+/// camera reads the EXIF header of the files it is missing for, in
+/// parallel, and stores it there for the next run.
+///
+/// A hash maps each path to its slot in the arrays. Removing a file only
+/// marks its slot dead in a Fenwick tree of live slots, so removal and
+/// the conversions between display position and slot are O(log n) and
+/// positions after it shift without moving any data. Dead slots are
+/// compacted away on the next sort, merge, or once they are half the
+/// arrays.
+class ImageFileIndex {
+public:
+  /// Published to other threads. Shared by every queued slot
+  /// instead of deep-copied for each
+  using Snapshot = std::shared_ptr<const ImageFileIndex>;
+
+  /// Lists above this are sorted on several threads
+  static constexpr inline std::size_t PARALLEL_SORT_THRESHOLD = 16384;
+
+  /// Replace the contents with these files. Stats them in parallel
+  void assign(const std::vector<QString> &paths);
+  void clear();
+
+  /// Stable in both orders, files with equal keys keep their order
+  void sort(SortBy by, SortOrder order);
+
+  /// Sorts by keys from the EXIF data rather than the filesystem
+  static bool sortsByMetadata(SortBy by) {
+    return by == SortBy::capture_time || by == SortBy::camera;
+  }
+
+  /// Reads the EXIF sort keys of the files not in the disk cache,
+  /// spread over the cores, and caches them
+  void readMetadata();
+
+  /// Add files to a list already sorted this way. The batch is sorted
+  /// on its own and merged in, in linear time
+  void merge(ImageFileIndex batch, SortBy by, SortOrder order);
+
+  std::size_t size() const { return m_paths.size() - m_deadSlots; }
+  bool empty() const { return size() == 0; }
+
+  const QString &path(std::size_t index) const {
+    return m_paths[slotAt(index)];
+  }
+  qint64 fileSize(std::size_t index) const { return m_sizes[slotAt(index)]; }
+  qint64 lastModified(std::size_t index) const {
+    return m_lastModified[slotAt(index)];
+  }
+
+  /// All zero unless the file is in the disk cache
+  const CachedMetadata &metadata(std::size_t index) const {
+    return m_metadata[slotAt(index)];
+  }
+
+  /// O(1) while nothing was removed since the last compaction,
+  /// O(log n) after
+  std::optional<std::size_t> indexOf(const QString &path) const;
+  bool contains(const QString &path) const {
+    return m_slotByPath.contains(path);
+  }
+
+  /// O(log n), later files move up by one
+  void remove(std::size_t index);
+
+private:
+  std::size_t slotAt(std::size_t index) const;
+  std::size_t indexOfSlot(std::size_t slot) const;
+  void removeSlot(std::size_t slot);
+  void compact();
+  void rebuildLookup();
+
+  void applyOrder(const std::vector<std::uint32_t> &order);
+  void append(ImageFileIndex &&other);
+
+  /// Calls fn with the key array that sorts by `by`
+  template <typename Function>
+  void withSortKeys(SortBy by, Function fn) const;
+
+  std::vector<QString> m_paths;
+  std::vector<qint64> m_sizes;
+  std::vector<qint64> m_lastModified; // ms since epoch
+  std::vector<QString> m_nameKeys;
+  std::vector<CachedMetadata> m_metadata;
+  std::vector<std::uint8_t> m_metadataKnown; // from the disk cache or EXIF
+
+  QHash<QString, std::uint32_t> m_slotByPath;
+
+  /// 1-based Fenwick tree over the slots, 1 for live and 0 for dead.
+  /// Only consulted while there are dead slots
+  std::vector<std::int32_t> m_liveSlots;
+  std::vector<bool> m_dead;
+  std::size_t m_deadSlots{0};
+};
\ No newline at end of file
@@ -1,8 +1,25 @@
 #pragma once
+#include <QLocale>
+#include <QString>
 
 struct ImageInfo {
-  int width;
-  int height;
+  /// Resolution of the image file, not of the decoded pixmap
+  int width{0};
+  int height{0};
+
+  /// The pixmap is a reduced stand-in for the full decode
+  bool isProxy{false};
+
+  /// Large enough to be worth drawing as tiles, and stored in
+  /// a format that can decode a clipped region on its own
+  bool tileable{false};
+
+  /// Has more than one frame, the pixmap is the first
+  bool animated{false};
+
+  /// Decoded from the part of the file read so far, the
+  /// complete decode follows
+  bool partial{false};
 };
 
 static inline QString prettyPrintSize(qint64 size) {
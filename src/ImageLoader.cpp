@@ -1,427 +1,1435 @@
 #include "ImageLoader.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 namespace fs = std::filesystem;
 
-std::vector<QString> getImageFiles(const char *directory) {
-  std::vector<QString> imageFiles;
+bool hasImageExtension(const fs::path &path) {
+  std::string extension = path.extension();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 ::tolower);
 
-  for (const auto &entry : fs::directory_iterator(directory)) {
-    if (entry.is_regular_file()) {
+  const std::vector<std::string> allowedExtensions = {
+      ".jpg", ".jpeg", ".png", ".nef", ".heic", ".tiff", ".webp", ".gif"};
 
-      std::string extension = entry.path().extension();
-      std::transform(extension.begin(), extension.end(), extension.begin(),
-                     ::tolower);
+  return std::find(allowedExtensions.begin(), allowedExtensions.end(),
+                   extension) != allowedExtensions.end();
+}
+
+/// Opens from the mapping when there is one, LibRaw then reads the
+/// file through the page cache instead of its own buffered reads
+int openRawFile(LibRaw &rawProcessor, const MappedFile &mappedFile,
+                const QString &imagePath) {
+  if (mappedFile.isValid()) {
+    return rawProcessor.open_buffer(mappedFile.data(),
+                                    static_cast<size_t>(mappedFile.size()));
+  }
+  return rawProcessor.open_file(imagePath.toLocal8Bit().data());
+}
 
-      const std::vector<std::string> allowedExtensions = {
-          ".jpg", ".jpeg", ".png", ".nef", ".heic", ".tiff", ".webp"};
+bool isImageFile(const fs::directory_entry &entry) {
+  std::error_code error;
+  return entry.is_regular_file(error) && hasImageExtension(entry.path());
+}
 
-      if (std::find(allowedExtensions.begin(), allowedExtensions.end(),
-                    extension) != allowedExtensions.end()) {
-        imageFiles.push_back(QString::fromStdString(entry.path().string()));
-      }
+/// Walk the directory and pass the image files on in batches. Batches
+/// double in size, so the first one arrives quickly and the number of
+/// merges into the sorted list stays logarithmic
+void scanImageFiles(
+    const QString &directory, const QString &skipPath,
+    const std::atomic<bool> &cancelled,
+    const std::function<void(std::vector<QString> batch, bool finished)>
+        &onBatch) {
+  Trace::Span span("io", "scan directory", directory);
+  std::size_t batchSize = ImageLoader::FIRST_SCAN_BATCH;
+  std::vector<QString> batch;
+
+  /// Errors end the scan early rather than throwing, a network
+  /// share that goes away should not take the loader with it
+  std::error_code error;
+  fs::directory_iterator it(directory.toStdString(), error);
+  for (; !error && it != fs::directory_iterator(); it.increment(error)) {
+    if (cancelled) {
+      return;
+    }
+    if (!isImageFile(*it)) {
+      continue;
+    }
+
+    auto imagePath = QString::fromStdString(it->path().string());
+    if (imagePath == skipPath) {
+      continue;
     }
-  }
 
-  std::sort(imageFiles.begin(), imageFiles.end());
+    batch.push_back(std::move(imagePath));
+    if (batch.size() >= batchSize) {
+      onBatch(std::move(batch), false);
+      batch = {};
+      batchSize = std::min(batchSize * 2, ImageLoader::MAX_SCAN_BATCH);
+    }
+  }
 
-  return imageFiles;
+  if (!cancelled) {
+    onBatch(std::move(batch), true);
+  }
 }
 
-ImageLoader::ImageLoader() : QObject() {}
+ImageLoader::ImageLoader()
+    : QObject(), m_decodeOptions(DecodeOptions::fromPreferences()) {
+  m_rawPreviewMode = Preferences::get(Preferences::SETTING_RAW_PREVIEW_MODE,
+                                      Preferences::RAW_PREVIEW_THEN_FULL)
+                         .toInt();
+  m_screenResolutionDecode =
+      Preferences::get(Preferences::SETTING_SCREEN_RESOLUTION_DECODE, true)
+          .toBool();
+  updateCacheBudget();
+  updatePrefetchWindow();
+
+  m_scanPool.setMaxThreadCount(1);
+
+  /// Writes take the cache's lock one at a time anyway
+  m_diskCachePool.setMaxThreadCount(1);
+  m_diskCachePool.setThreadPriority(QThread::LowPriority);
+
+  /// Picks and checks the pixel kernels before the first decode needs them
+  PixelKernels::initialize();
+
+  /// A child, so it moves to the loader thread along with us
+  m_folderWatcher = new FolderWatcher(this);
+  connect(m_folderWatcher, &FolderWatcher::filesWritten, this,
+          &ImageLoader::onFilesWritten);
+  connect(m_folderWatcher, &FolderWatcher::filesRemoved, this,
+          &ImageLoader::onFilesRemoved);
+  connect(m_folderWatcher, &FolderWatcher::filesRenamed, this,
+          &ImageLoader::onFilesRenamed);
+
+  m_slideshowTimer = new QTimer(this);
+  m_slideshowTimer->setSingleShot(true);
+  m_slideshowTimer->setTimerType(Qt::PreciseTimer);
+  connect(m_slideshowTimer, &QTimer::timeout, this,
+          &ImageLoader::onSlideshowDeadline);
+  m_clock.start();
+}
 
-void ImageLoader::loadImagePathsIfEmpty(const char *directory,
-                                        const char *current_file) {
-  if (m_imageFilePaths.empty()) {
-    m_imageFilePaths = getImageFiles(directory);
+ImageLoader::~ImageLoader() { cancelDirectoryScan(); }
 
-    /// Use the current sort settings and sort
-    /// this vector of paths
-    ImageLoader::SortFunction compare_fn;
-    if (m_currentSortByType == SortBy::name) {
-      compare_fn = compareFilePathsByName;
-    } else if (m_currentSortByType == SortBy::size) {
-      compare_fn = compareFilePathsBySize;
-    } else if (m_currentSortByType == SortBy::date_modified) {
-      compare_fn = compareFilePathsByDateModified;
+void ImageLoader::loadImagePathsIfEmpty(const QString &directory,
+                                        const QString &currentFile) {
+  if (m_imageFiles.empty()) {
+    /// Start with only the opened image so it is decoded
+    /// right away, the rest of the folder streams in behind
+    m_imageFiles.assign({currentFile});
+    if (ImageFileIndex::sortsByMetadata(m_currentSortByType)) {
+      m_imageFiles.readMetadata();
     }
+    m_currentIndex = 0;
+    emit imageFilesChanged(
+        std::make_shared<const ImageFileIndex>(m_imageFiles));
 
-    if (m_currentSortOrder == SortOrder::ascending) {
-      // Sort ascending order
-      std::sort(m_imageFilePaths.begin(), m_imageFilePaths.end(), compare_fn);
-    } else {
-      // Sort descending order
-      std::sort(m_imageFilePaths.rbegin(), m_imageFilePaths.rend(), compare_fn);
-    }
+    /// Watch before scanning so nothing
+    /// written in between is missed
+    m_folderWatcher->watch(directory);
+    startDirectoryScan(directory, currentFile);
+  }
+}
 
-    auto it = std::find(m_imageFilePaths.begin(), m_imageFilePaths.end(),
-                        current_file);
-    int index = (it != m_imageFilePaths.end())
-                    ? std::distance(m_imageFilePaths.begin(), it)
-                    : -1;
+void ImageLoader::startDirectoryScan(const QString &directory,
+                                     const QString &skipPath) {
+  cancelDirectoryScan();
+
+  auto scan = std::make_shared<std::atomic<bool>>(false);
+  m_directoryScan = scan;
+
+  /// A change of sort during the scan reads the rest on the loader thread
+  const bool readMetadata =
+      ImageFileIndex::sortsByMetadata(m_currentSortByType);
+
+  m_scanPool.start([this, directory, skipPath, scan, readMetadata]() {
+    scanImageFiles(
+        directory, skipPath, *scan,
+        [this, scan, readMetadata](std::vector<QString> paths,
+                                   bool finished) {
+          /// Stat the batch here, off the loader thread
+          ImageFileIndex batch;
+          batch.assign(paths);
+          if (readMetadata) {
+            batch.readMetadata();
+          }
+
+          QMetaObject::invokeMethod(
+              this,
+              [this, scan, batch = std::move(batch), finished]() {
+                onScanBatch(scan, batch, finished);
+              },
+              Qt::QueuedConnection);
+        });
+  });
+}
 
-    if (index == -1) {
-      // bad
-    } else {
-      m_currentIndex = index;
+void ImageLoader::cancelDirectoryScan() {
+  if (m_directoryScan) {
+    *m_directoryScan = true;
+    m_directoryScan.reset();
+  }
+  m_changedDuringScan.clear();
+}
+
+void ImageLoader::onScanBatch(const std::shared_ptr<std::atomic<bool>> &scan,
+                              ImageFileIndex batch, bool finished) {
+  if (scan != m_directoryScan) {
+    /// From a scan of a folder that is no longer open
+    return;
+  }
+
+  /// The watcher already added or removed these
+  if (!m_changedDuringScan.isEmpty()) {
+    for (auto i = batch.size(); i-- > 0;) {
+      if (m_changedDuringScan.contains(batch.path(i))) {
+        batch.remove(i);
+      }
     }
   }
+
+  if (finished) {
+    m_directoryScan.reset();
+    m_changedDuringScan.clear();
+  }
+  if (batch.empty()) {
+    return;
+  }
+
+  const bool wasEmpty = m_imageFiles.empty();
+  QString currentImagePath;
+  if (!wasEmpty) {
+    currentImagePath = m_imageFiles.path(m_currentIndex);
+  }
+
+  /// Sorted as the list is now, which may differ
+  /// from the order when the scan started
+  insertImageFiles(std::move(batch));
+
+  if (wasEmpty) {
+    /// Everything seen so far was deleted
+    m_currentIndex = 0;
+    showCurrentImage();
+    return;
+  }
+
+  auto index = m_imageFiles.indexOf(currentImagePath);
+  if (index) {
+    m_currentIndex = *index;
+  }
+
+  /// New neighbours may have arrived
+  prefetchAroundCurrentImage();
 }
 
-ImageInfo ImageLoader::loadRaw(const QString &imagePath, QPixmap &imagePixmap) {
+void ImageLoader::insertImageFiles(ImageFileIndex batch) {
+  /// Read here, so the views merge with the same keys and
+  /// never have to read a file themselves
+  if (ImageFileIndex::sortsByMetadata(m_currentSortByType)) {
+    batch.readMetadata();
+  }
+  m_imageFiles.merge(batch, m_currentSortByType, m_currentSortOrder);
+  emit imageFilesInserted(batch, m_currentSortByType, m_currentSortOrder);
+}
+
+ImageInfo ImageLoader::loadRaw(const QString &imagePath,
+                               const DecodeOptions &options,
+                               QPixmap &imagePixmap) {
+  Trace::Span span("decode", "LibRaw", QFileInfo(imagePath).fileName());
 
   ImageInfo result;
 
-  m_rawProcessor.open_file(imagePath.toLocal8Bit().data());
+  /// Outlives the processor, which reads from it until the end
+  MappedFile mappedFile(imagePath);
+
+  /// Each decode runs on its own worker thread, so each one
+  /// borrows its own LibRaw instance. Parameters set below are
+  /// all the ones a recycled instance may still carry
+  auto rawProcessor = RawProcessorPool::instance().acquire();
 
-  m_rawProcessor.imgdata.params.half_size =
-      Preferences::get(Preferences::SETTING_RAW_HALF_SIZE, true).toBool() ? 1
-                                                                          : 0;
-  m_rawProcessor.imgdata.params.use_auto_wb =
-      Preferences::get(Preferences::SETTING_RAW_AUTO_WB, true).toBool() ? 1 : 0;
+  openRawFile(*rawProcessor, mappedFile, imagePath);
 
-  m_rawProcessor.unpack();
-  m_rawProcessor.dcraw_process();
+  rawProcessor->imgdata.params.half_size = options.rawHalfSize ? 1 : 0;
+  rawProcessor->imgdata.params.use_auto_wb = options.rawAutoWb ? 1 : 0;
+  rawProcessor->imgdata.params.output_bps = options.raw16Bit ? 16 : 8;
+
+  rawProcessor->unpack();
+  rawProcessor->dcraw_process();
 
   // Access the image resolution
-  result.width = m_rawProcessor.imgdata.sizes.raw_width;
-  result.height = m_rawProcessor.imgdata.sizes.raw_height;
+  result.width = rawProcessor->imgdata.sizes.raw_width;
+  result.height = rawProcessor->imgdata.sizes.raw_height;
 
   libraw_processed_image_t *processed_image =
-      m_rawProcessor.dcraw_make_mem_image();
+      rawProcessor->dcraw_make_mem_image();
+  if (!processed_image) {
+    return result;
+  }
 
-  // Check if the depth is 16 bits
-  QImage::Format format = (processed_image->bits == 16) ? QImage::Format_RGB16
-                                                        : QImage::Format_RGB888;
+  const QImage image = wrapProcessedImage(processed_image);
+  Trace::Span toPixmap("convert", "QPixmap::fromImage");
+  imagePixmap = QPixmap::fromImage(image);
+
+  return result;
+}
 
-  QImage image(processed_image->data, processed_image->width,
-               processed_image->height, format);
+QImage ImageLoader::wrapProcessedImage(libraw_processed_image_t *processed) {
+  Trace::Span span("convert", "LibRaw output");
+  const int width = processed->width;
+  const int height = processed->height;
 
-  // Convert QImage to QPixmap and display it
-  imagePixmap = QPixmap::fromImage(image);
+  if (processed->colors != 3 ||
+      (processed->bits != 8 && processed->bits != 16)) {
+    LibRaw::dcraw_clear_mem(processed);
+    return {};
+  }
+
+  if (processed->bits == 8) {
+    /// QPixmap::fromImage would convert packed RGB to RGB32 with a copy
+    /// anyway, converting here does it in the same single pass with the
+    /// vector kernels and leaves nothing to convert
+    QImage image(width, height, QImage::Format_RGB32);
+    if (!image.isNull()) {
+      for (int y = 0; y < height; ++y) {
+        PixelKernels::rgb888ToRgb32(
+            processed->data + qsizetype(y) * width * 3,
+            reinterpret_cast<quint32 *>(image.scanLine(y)), width);
+      }
+    }
+    LibRaw::dcraw_clear_mem(processed);
+    return image;
+  }
+
+  /// QImage has no 48-bit RGB format. Expanding into RGBX64 is one pass
+  /// and keeps all 16 bits, where RGB16 would have been 5-6-5
+  QImage image(width, height, QImage::Format_RGBX64);
+  if (!image.isNull()) {
+    const auto *source = reinterpret_cast<const quint16 *>(processed->data);
+    for (int y = 0; y < height; ++y) {
+      PixelKernels::rgb48ToRgbx64(
+          source + qsizetype(y) * width * 3,
+          reinterpret_cast<quint16 *>(image.scanLine(y)), width);
+    }
+  }
+  LibRaw::dcraw_clear_mem(processed);
+  return image;
+}
+
+ImageInfo ImageLoader::loadRawPreview(const QString &imagePath,
+                                      const DecodeOptions &options,
+                                      QPixmap &imagePixmap) {
+  Trace::Span span("decode", "LibRaw preview",
+                   QFileInfo(imagePath).fileName());
+
+  ImageInfo result;
+
+  MappedFile mappedFile(imagePath);
+  auto rawProcessor = RawProcessorPool::instance().acquire();
+
+  if (openRawFile(*rawProcessor, mappedFile, imagePath) != LIBRAW_SUCCESS ||
+      rawProcessor->unpack_thumb() != LIBRAW_SUCCESS) {
+    /// No usable preview, fall back to the full decode
+    return loadRaw(imagePath, options, imagePixmap);
+  }
+
+  result.width = rawProcessor->imgdata.sizes.raw_width;
+  result.height = rawProcessor->imgdata.sizes.raw_height;
+  result.isProxy = true;
+
+  int error = LIBRAW_SUCCESS;
+  libraw_processed_image_t *thumbnail =
+      rawProcessor->dcraw_make_mem_thumb(&error);
+  if (!thumbnail) {
+    return loadRaw(imagePath, options, imagePixmap);
+  }
+
+  QImage image;
+  if (thumbnail->type == LIBRAW_IMAGE_JPEG) {
+    image = QImage::fromData(thumbnail->data, thumbnail->data_size, "JPG");
+  } else if (thumbnail->type == LIBRAW_IMAGE_BITMAP && thumbnail->bits == 8 &&
+             thumbnail->colors == 3) {
+    image = QImage(thumbnail->width, thumbnail->height, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+      PixelKernels::rgb888ToRgb32(
+          thumbnail->data + qsizetype(y) * thumbnail->width * 3,
+          reinterpret_cast<quint32 *>(image.scanLine(y)), thumbnail->width);
+    }
+  }
+  LibRaw::dcraw_clear_mem(thumbnail);
 
-  m_rawProcessor.dcraw_clear_mem(processed_image);
+  if (image.isNull()) {
+    return loadRaw(imagePath, options, imagePixmap);
+  }
+
+  /// The preview is stored unrotated, the camera orientation
+  /// lives in the RAW metadata
+  QTransform rotation;
+  switch (rawProcessor->imgdata.sizes.flip) {
+  case 3:
+    rotation.rotate(180);
+    break;
+  case 5:
+    rotation.rotate(270);
+    break;
+  case 6:
+    rotation.rotate(90);
+    break;
+  }
+  if (!rotation.isIdentity()) {
+    image = image.transformed(rotation);
+  }
+
+  Trace::Span toPixmap("convert", "QPixmap::fromImage");
+  imagePixmap = QPixmap::fromImage(image);
 
   return result;
 }
 
 ImageInfo ImageLoader::loadWithImageReader(const QString &imagePath,
+                                           const DecodeOptions &options,
                                            QPixmap &imagePixmap) {
+  Trace::Span span("decode", "QImageReader", QFileInfo(imagePath).fileName());
+
+  /// Decode from the mapped file, only the pages the decoder
+  /// touches are read and nothing is copied into buffers first
+  MappedFile mappedFile(imagePath);
+  QImageReader imageReader;
+  if (mappedFile.isValid()) {
+    imageReader.setDevice(mappedFile.device());
+  } else {
+    imageReader.setFileName(imagePath);
+  }
+  return readWithImageReader(imageReader, imagePath, options, imagePixmap);
+}
 
+ImageInfo ImageLoader::readWithImageReader(QImageReader &imageReader,
+                                           const QString &imagePath,
+                                           const DecodeOptions &options,
+                                           QPixmap &imagePixmap) {
   ImageInfo result;
-
-  QImageReader imageReader(imagePath);
   imageReader.setAllocationLimit(0);
   imageReader.setAutoTransform(true);
 
-  QImage image = imageReader.read();
+  /// Only the first frame is decoded here, the viewer plays the rest
+  result.animated =
+      imageReader.supportsAnimation() && imageReader.imageCount() != 1;
+
+  // Stored size, before the EXIF orientation is applied
+  QSize imageSize = imageReader.size();
+  const bool transposed = imageReader.transformation() &
+                          QImageIOHandler::TransformationRotate90;
+
+  /// Size to reduce to after decoding, for formats that cannot decode
+  /// at a smaller size. Already in display orientation
+  QSize downscaledSize;
+
+  /// Size of the reduced image in display orientation, if one is wanted
+  QSize proxySize;
+
+  if (options.targetSize.isValid() && imageSize.isValid()) {
+    QSize targetSize = options.targetSize;
+    if (transposed) {
+      targetSize.transpose();
+    }
+
+    if (imageSize.width() > targetSize.width() ||
+        imageSize.height() > targetSize.height()) {
+      const QSize scaledSize =
+          imageSize.scaled(targetSize, Qt::KeepAspectRatio);
+      proxySize = transposed ? scaledSize.transposed() : scaledSize;
+      if (imageReader.supportsOption(QImageIOHandler::ScaledSize)) {
+        /// JPEG scales in the DCT domain here, so a
+        /// smaller decode is also a faster one
+        imageReader.setScaledSize(scaledSize);
+      } else {
+        /// QImageReader would scale with QImage::scaled, the
+        /// area-averaging kernels are faster and sharper
+        downscaledSize = proxySize;
+      }
+      result.isProxy = true;
+    }
+  }
+
+  QImage image;
+  if (proxySize.isValid() && !result.animated) {
+    /// A pre-warmed proxy is a fraction of the original to decode
+    const QFileInfo fileInfo(imagePath);
+    image = DiskCache::instance().proxy(
+        imagePath, fileInfo.size(),
+        fileInfo.lastModified().toMSecsSinceEpoch(), proxySize);
+  }
+  if (image.isNull()) {
+    image = imageReader.read();
+    if (!image.isNull() && downscaledSize.isValid()) {
+      image = PixelKernels::downscale(image, downscaledSize);
+    }
+  }
   if (image.isNull()) {
     /// TODO: Show warning message
     // QMessageBox::warning(this, "Error", "Failed to open the image.");
   } else {
-    imagePixmap = QPixmap::fromImage(image);
-    result.width = imagePixmap.width();
-    result.height = imagePixmap.height();
+    {
+      Trace::Span toPixmap("convert", "QPixmap::fromImage");
+      imagePixmap = QPixmap::fromImage(image);
+    }
+    if (result.isProxy) {
+      result.width = transposed ? imageSize.height() : imageSize.width();
+      result.height = transposed ? imageSize.width() : imageSize.height();
+
+      /// Tiles are clipped from the stored image, so this only
+      /// works without an EXIF orientation to undo
+      result.tileable =
+          static_cast<qint64>(result.width) * result.height >=
+              TILED_MIN_PIXELS &&
+          imageReader.transformation() == QImageIOHandler::TransformationNone &&
+          imageReader.supportsOption(QImageIOHandler::ClipRect) &&
+          !result.animated;
+    } else {
+      result.width = imagePixmap.width();
+      result.height = imagePixmap.height();
+    }
   }
 
   return result;
 }
 
+bool ImageLoader::isRaw(const QString &imagePath) {
+  static const QStringList rawFormats = {"nef", "cr2", "arw", "dng", "orf",
+                                         "pef", "rw2", "srw", "crw", "raf"};
+
+  return rawFormats.contains(QFileInfo(imagePath).suffix().toLower());
+}
+
 ImageInfo ImageLoader::loadImageIntoPixmap(const QString &imagePath,
+                                           const DecodeOptions &options,
                                            QPixmap &imagePixmap) {
-  QFileInfo fileInfo(imagePath);
+  if (isRaw(imagePath)) {
+    if (options.rawEmbeddedPreview) {
+      return loadRawPreview(imagePath, options, imagePixmap);
+    }
+    return loadRaw(imagePath, options, imagePixmap);
+  } else {
+    return loadWithImageReader(imagePath, options, imagePixmap);
+  }
+}
+
+ImageInfo ImageLoader::loadProgressively(
+    const QString &imagePath, const DecodeOptions &options,
+    QPixmap &imagePixmap, const std::function<bool()> &isStale,
+    const std::function<void(const QPixmap &, const ImageInfo &)>
+        &onPartial) {
+  const QFileInfo fileInfo(imagePath);
+
+  /// A stored proxy decodes faster than any partial of the original
+  const bool proxyStored =
+      options.targetSize.isValid() &&
+      DiskCache::instance().hasProxy(
+          imagePath, fileInfo.size(),
+          fileInfo.lastModified().toMSecsSinceEpoch());
+  if (isRaw(imagePath) || fileInfo.size() < PROGRESSIVE_MIN_BYTES ||
+      proxyStored) {
+    return loadImageIntoPixmap(imagePath, options, imagePixmap);
+  }
+
+  MappedFile mappedFile(imagePath);
+  if (!mappedFile.isValid()) {
+    return loadImageIntoPixmap(imagePath, options, imagePixmap);
+  }
 
-  QStringList rawFormats = {"nef", "cr2", "arw", "dng", "orf",
-                            "pef", "rw2", "srw", "crw", "raf"};
+  /// Reading is faulting the pages of the mapping in, a chunk at a
+  /// time. Partials decode the prefix read so far, also from the
+  /// mapping, so nothing is ever copied
+  const auto *data = reinterpret_cast<const char *>(mappedFile.data());
+  const qint64 size = mappedFile.size();
+  qint64 read = 0;
+  auto readChunk = [&]() {
+    const qint64 end = std::min(size, read + PROGRESSIVE_CHUNK_BYTES);
+    volatile char touched = 0;
+    for (qint64 offset = read; offset < end; offset += PAGE_BYTES) {
+      touched = touched ^ data[offset];
+    }
+    read = end;
+  };
+
+  QElapsedTimer readTimer;
+  readTimer.start();
+  readChunk();
+
+  /// Local storage reads the whole file before the first interval, it
+  /// decodes straight from the mapping like any other image
+  const qint64 estimatedReadNs =
+      readTimer.nsecsElapsed() * (size / PROGRESSIVE_CHUNK_BYTES + 1);
+  if (estimatedReadNs < PROGRESSIVE_INTERVAL_MS * 1'000'000) {
+    QImageReader imageReader(mappedFile.device());
+    return readWithImageReader(imageReader, imagePath, options, imagePixmap);
+  }
+
+  Trace::Span span("decode", "progressive", fileInfo.fileName());
+
+  /// Qt has no incremental decoding, a format that cannot decode a
+  /// truncated file would spend a whole decode to find that out
+  const bool isJpeg = uchar(data[0]) == 0xFF && uchar(data[1]) == 0xD8;
+  int partialsLeft = isJpeg ? PROGRESSIVE_MAX_PARTIALS : 0;
+  qint64 nextPartialMs = PROGRESSIVE_INTERVAL_MS;
+
+  while (read < size) {
+    if (isStale()) {
+      /// Moved on, the rest of a slow read is not worth waiting for
+      return {};
+    }
+    readChunk();
+
+    if (partialsLeft == 0 || read == size ||
+        readTimer.elapsed() < nextPartialMs) {
+      continue;
+    }
+
+    const qint64 startedMs = readTimer.elapsed();
+    QByteArray prefix = QByteArray::fromRawData(data, read);
+    QBuffer buffer(&prefix);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader imageReader(&buffer);
+    QPixmap partialPixmap;
+    ImageInfo partialInfo =
+        readWithImageReader(imageReader, imagePath, options, partialPixmap);
+    if (partialPixmap.isNull()) {
+      /// Damaged, or no scan complete yet. Read the rest quietly
+      partialsLeft = 0;
+      continue;
+    }
+    --partialsLeft;
+    partialInfo.partial = true;
+    partialInfo.tileable = false;
+    partialInfo.animated = false;
+    onPartial(partialPixmap, partialInfo);
+
+    /// Each partial decodes a longer prefix, spend at most
+    /// half of the time on them and the rest on reading
+    const qint64 decodeMs = readTimer.elapsed() - startedMs;
+    nextPartialMs =
+        readTimer.elapsed() + std::max(PROGRESSIVE_INTERVAL_MS, decodeMs);
+  }
+
+  QImageReader imageReader(mappedFile.device());
+  return readWithImageReader(imageReader, imagePath, options, imagePixmap);
+}
+
+void ImageLoader::rememberInDiskCache(const QString &imagePath,
+                                      qint64 lastModified,
+                                      const QPixmap &imagePixmap,
+                                      const ImageInfo &imageInfo) {
+  const qint64 fileSize = QFileInfo(imagePath).size();
+
+  CachedMetadata metadata;
+  if (DiskCache::instance().lookup(imagePath, fileSize, lastModified,
+                                   metadata) &&
+      metadata.width > 0) {
+    /// Already known from an earlier decode
+    return;
+  }
+
+  const auto exif = ExifReader::read(imagePath);
+  metadata.width = imageInfo.width;
+  metadata.height = imageInfo.height;
+  metadata.orientation = exif.orientation;
+  metadata.captureTime = exif.captureTime;
+  metadata.camera = exif.camera;
+  metadata.sequence = exif.imageNumber;
+
+  DiskCache::instance().store(imagePath, fileSize, lastModified, metadata,
+                              imagePixmap.toImage());
+}
+
+void ImageLoader::onFilesWritten(const QStringList &paths) {
+  std::vector<QString> imagePaths;
+  for (const auto &imagePath : paths) {
+    if (hasImageExtension(imagePath.toStdString())) {
+      imagePaths.push_back(imagePath);
+    }
+  }
+  if (imagePaths.empty()) {
+    return;
+  }
 
-  if (rawFormats.contains(fileInfo.suffix().toLower())) {
-    return loadRaw(imagePath, imagePixmap);
+  const bool wasEmpty = m_imageFiles.empty();
+  QString currentImagePath;
+  if (!wasEmpty) {
+    currentImagePath = m_imageFiles.path(m_currentIndex);
+  }
+  bool currentImageChanged = false;
+  QStringList rewrittenPaths;
+
+  for (const auto &imagePath : imagePaths) {
+    if (m_directoryScan) {
+      m_changedDuringScan.insert(imagePath);
+    }
+
+    /// A file written over is removed and added back,
+    /// its size and date may sort it somewhere else
+    auto index = m_imageFiles.indexOf(imagePath);
+    if (index) {
+      m_imageFiles.remove(*index);
+      m_imageCache.remove(imagePath);
+      rewrittenPaths.append(imagePath);
+      currentImageChanged |= imagePath == currentImagePath;
+    }
+  }
+
+  if (!rewrittenPaths.isEmpty()) {
+    emit imageFilesRemoved(rewrittenPaths);
+  }
+
+  ImageFileIndex batch;
+  batch.assign(imagePaths);
+  insertImageFiles(std::move(batch));
+
+  if (wasEmpty) {
+    m_currentIndex = 0;
+    showCurrentImage();
+    return;
+  }
+
+  auto index = m_imageFiles.indexOf(currentImagePath);
+  if (index) {
+    m_currentIndex = *index;
+  }
+
+  if (currentImageChanged) {
+    showCurrentImage();
+  } else {
+    prefetchAroundCurrentImage();
+  }
+}
+
+void ImageLoader::onFilesRemoved(const QStringList &paths) {
+  if (m_imageFiles.empty()) {
+    return;
+  }
+
+  const auto currentImagePath = m_imageFiles.path(m_currentIndex);
+  bool currentImageRemoved = false;
+  QStringList removedPaths;
+
+  for (const auto &imagePath : paths) {
+    if (m_directoryScan) {
+      m_changedDuringScan.insert(imagePath);
+    }
+
+    auto index = m_imageFiles.indexOf(imagePath);
+    if (!index) {
+      continue;
+    }
+    m_imageFiles.remove(*index);
+    m_imageCache.remove(imagePath);
+    removedPaths.append(imagePath);
+
+    /// Keep pointing at the same image, or at the
+    /// one after it if the current one went away
+    if (*index < m_currentIndex) {
+      m_currentIndex -= 1;
+    } else if (*index == m_currentIndex) {
+      currentImageRemoved = true;
+    }
+  }
+
+  if (removedPaths.isEmpty()) {
+    return;
+  }
+  emit imageFilesRemoved(removedPaths);
+
+  if (m_imageFiles.empty()) {
+    m_currentIndex = 0;
+    emit noMoreImagesLeft();
+  } else if (currentImageRemoved) {
+    m_currentIndex = std::min(m_currentIndex, m_imageFiles.size() - 1);
+    showCurrentImage();
   } else {
-    return loadWithImageReader(imagePath, imagePixmap);
+    prefetchAroundCurrentImage();
+  }
+}
+
+void ImageLoader::onFilesRenamed(const QStringList &from,
+                                 const QStringList &to) {
+  QStringList removed;
+  QStringList written;
+  QStringList renamedFrom;
+  std::vector<QString> renamedTo;
+  for (qsizetype i = 0; i < from.size(); ++i) {
+    if (!m_imageFiles.contains(from[i])) {
+      /// E.g. a temporary file an editor saves through
+      written.append(to[i]);
+    } else if (!hasImageExtension(to[i].toStdString())) {
+      removed.append(from[i]);
+    } else {
+      renamedFrom.append(from[i]);
+      renamedTo.push_back(to[i]);
+    }
+  }
+
+  if (!removed.isEmpty()) {
+    onFilesRemoved(removed);
+  }
+
+  if (!renamedFrom.isEmpty()) {
+    const auto currentImagePath = m_imageFiles.path(m_currentIndex);
+    QString currentImageRenamedTo;
+    QStringList removedPaths;
+
+    for (qsizetype i = 0; i < renamedFrom.size(); ++i) {
+      if (m_directoryScan) {
+        m_changedDuringScan.insert(renamedFrom[i]);
+        m_changedDuringScan.insert(renamedTo[i]);
+      }
+
+      /// Renamed over another image, which it replaces
+      for (const auto &imagePath : {renamedFrom[i], renamedTo[i]}) {
+        auto index = m_imageFiles.indexOf(imagePath);
+        if (!index) {
+          continue;
+        }
+        m_imageFiles.remove(*index);
+        m_imageCache.remove(imagePath);
+        removedPaths.append(imagePath);
+        if (imagePath == currentImagePath) {
+          currentImageRenamedTo = renamedTo[i];
+        }
+      }
+    }
+    emit imageFilesRemoved(removedPaths);
+
+    /// The new names may sort somewhere else
+    ImageFileIndex batch;
+    batch.assign(renamedTo);
+    insertImageFiles(std::move(batch));
+
+    /// Follow the image on screen to its new name instead
+    /// of moving on to a neighbour
+    const auto index = m_imageFiles.indexOf(
+        currentImageRenamedTo.isEmpty() ? currentImagePath
+                                        : currentImageRenamedTo);
+    if (m_imageFiles.empty()) {
+      m_currentIndex = 0;
+      emit noMoreImagesLeft();
+    } else {
+      m_currentIndex =
+          index ? *index : std::min(m_currentIndex, m_imageFiles.size() - 1);
+      if (!currentImageRenamedTo.isEmpty()) {
+        showCurrentImage();
+      } else {
+        prefetchAroundCurrentImage();
+      }
+    }
+  }
+
+  if (!written.isEmpty()) {
+    onFilesWritten(written);
   }
 }
 
 void ImageLoader::resetImageFilePaths() {
-  m_imageFilePaths.clear();
+  m_folderWatcher->stop();
+  cancelDirectoryScan();
+  m_imageFiles.clear();
   m_currentIndex = 0;
 }
 
-void ImageLoader::loadImage(const QString &imagePath) {
+void ImageLoader::updateCacheBudget() {
+  const qint64 megabytes =
+      Preferences::get(Preferences::SETTING_CACHE_SIZE_MB,
+                       Preferences::DEFAULT_CACHE_SIZE_MB)
+          .toLongLong();
+  m_imageCache.setBudget(megabytes * 1024 * 1024);
+}
 
-  QFileInfo fileInfo(imagePath);
-  QPixmap imagePixmap;
+void ImageLoader::setViewportSize(const QSize &size) {
+  m_viewportSize = size;
+}
+
+void ImageLoader::updatePrefetchWindow() {
+  m_prefetchWindow.setExtent(
+      Preferences::get(Preferences::SETTING_PREFETCH_AHEAD,
+                       Preferences::DEFAULT_PREFETCH_AHEAD)
+          .toInt(),
+      Preferences::get(Preferences::SETTING_PREFETCH_BEHIND,
+                       Preferences::DEFAULT_PREFETCH_BEHIND)
+          .toInt());
+
+  const qint64 megabytes =
+      Preferences::get(Preferences::SETTING_PREFETCH_MEMORY_MB,
+                       Preferences::DEFAULT_PREFETCH_MEMORY_MB)
+          .toLongLong();
+  m_prefetchMemoryBytes = megabytes * 1024 * 1024;
+}
 
-  loadImagePathsIfEmpty(fileInfo.dir().absolutePath().toLocal8Bit().data(),
-                        fileInfo.absoluteFilePath().toLocal8Bit().data());
+ImageCacheKey ImageLoader::cacheKeyFor(std::size_t index,
+                                       const DecodeOptions &options) const {
+  return {m_imageFiles.path(index), m_imageFiles.lastModified(index),
+          options.key()};
+}
 
-  m_currentImageInfo = loadImageIntoPixmap(imagePath, imagePixmap);
-  emit imageLoaded(fileInfo, imagePixmap, m_currentImageInfo);
+bool ImageLoader::proxyOptionsFor(const QString &imagePath,
+                                  DecodeOptions &options) const {
+  options = m_decodeOptions;
 
-  // Prefetch next and previous images
-  if (m_currentIndex >= 1) {
-    m_previousImageInfo = loadImageIntoPixmap(
-        m_imageFilePaths[m_currentIndex - 1], m_previousPixmap);
+  if (isRaw(imagePath)) {
+    /// Use the embedded preview
+    options.rawEmbeddedPreview =
+        m_rawPreviewMode != Preferences::RAW_PREVIEW_OFF;
+    return options.rawEmbeddedPreview;
   }
-  if (m_currentIndex + 1 < m_imageFilePaths.size()) {
-    m_nextImageInfo =
-        loadImageIntoPixmap(m_imageFilePaths[m_currentIndex + 1], m_nextPixmap);
+
+  /// Decode at the size it will be shown at
+  if (m_screenResolutionDecode && m_viewportSize.isValid()) {
+    options.targetSize = m_viewportSize;
+    return true;
   }
+
+  return false;
+}
+
+bool ImageLoader::fullDecodeFollowsProxy(const QString &imagePath) const {
+  return isRaw(imagePath) &&
+         m_rawPreviewMode == Preferences::RAW_PREVIEW_THEN_FULL;
+}
+
+void ImageLoader::requestDecode(const ImageCacheKey &key,
+                                const DecodeOptions &options, int priority) {
+  auto it = m_pendingDecodes.find(key);
+  if (it != m_pendingDecodes.end()) {
+    /// Already queued or decoding, keep it alive for this generation
+    m_decodePool.renew(it.value());
+    return;
+  }
+
+  auto ticket = m_decodePool.makeTicket();
+  m_pendingDecodes.insert(key, ticket);
+
+  m_decodePool.submit(
+      ticket, priority,
+      [this, key, ticket, options, priority]() {
+        if (isRaw(key.path) &&
+            options.version != m_decodeOptionsVersion.load()) {
+          /// RAW settings changed while this waited in the queue
+          QMetaObject::invokeMethod(
+              this, [this, key, ticket]() { onDecodeDropped(key, ticket); },
+              Qt::QueuedConnection);
+          return;
+        }
+
+        QElapsedTimer decodeTimer;
+        decodeTimer.start();
+        QPixmap imagePixmap;
+        ImageInfo imageInfo;
+        if (priority >= CURRENT_IMAGE_PRIORITY) {
+          /// Shown in parts while a slow file is still being read
+          imageInfo = loadProgressively(
+              key.path, options, imagePixmap,
+              [this, ticket]() { return m_decodePool.isStale(ticket); },
+              [this, key](const QPixmap &partialPixmap,
+                          const ImageInfo &partialInfo) {
+                QMetaObject::invokeMethod(
+                    this,
+                    [this, key, partialPixmap, partialInfo]() {
+                      onPartialImage(key, partialPixmap, partialInfo);
+                    },
+                    Qt::QueuedConnection);
+              });
+        } else {
+          imageInfo = loadImageIntoPixmap(key.path, options, imagePixmap);
+        }
+        const qint64 decodeMs = decodeTimer.elapsed();
+
+        /// A proxy decode of an image no larger than the proxy
+        /// already is the full resolution image
+        auto decodedKey = key;
+        if (!imageInfo.isProxy) {
+          decodedKey.options = options.fullResolution().key();
+        }
+
+        /// Hand the result back to the loader thread
+        QMetaObject::invokeMethod(
+            this,
+            [this, key, ticket, decodedKey, imagePixmap, imageInfo,
+             decodeMs]() {
+              onImageDecoded(key, ticket, decodedKey, imagePixmap, imageInfo,
+                             decodeMs);
+            },
+            Qt::QueuedConnection);
+
+        /// The image is on its way to the screen, the
+        /// thumbnail encode and cache write can wait
+        if (!imagePixmap.isNull()) {
+          m_diskCachePool.start([key, imagePixmap, imageInfo]() {
+            rememberInDiskCache(key.path, key.lastModified, imagePixmap,
+                                imageInfo);
+          });
+        }
+      },
+      [this, key, ticket]() {
+        QMetaObject::invokeMethod(
+            this, [this, key, ticket]() { onDecodeDropped(key, ticket); },
+            Qt::QueuedConnection);
+      });
+}
+
+void ImageLoader::onImageDecoded(const ImageCacheKey &requestKey,
+                                 const DecodePool::Ticket &ticket,
+                                 const ImageCacheKey &key,
+                                 const QPixmap &imagePixmap,
+                                 const ImageInfo &imageInfo,
+                                 qint64 decodeMs) {
+  if (m_pendingDecodes.value(requestKey) == ticket) {
+    m_pendingDecodes.remove(requestKey);
+  }
+
+  if (imagePixmap.isNull()) {
+    if (requestKey == m_currentImageKey || requestKey == m_currentProxyKey) {
+      /// Nothing to wait for, the slideshow moves on at the next deadline
+      resumeSlideshow();
+    }
+    return;
+  }
+
+  m_imageCache.insert(key, imagePixmap, imageInfo);
+  m_lastFrameBytes = ImageCache::bytesFor(imagePixmap);
+  m_slideshow.recordDecode(decodeMs);
+
+  if (key == m_clipboardKey) {
+    m_clipboardKey = {};
+    emit fullResolutionImageCopied(imagePixmap);
+
+    /// Copying does not replace the proxy on screen
+    if (!m_currentImageWanted) {
+      return;
+    }
+  }
+
+  if (key == m_currentImageKey && m_currentImageWanted &&
+      !m_currentImageShown) {
+    m_currentImageShown = true;
+    showDecodedImage(key.path, imagePixmap, imageInfo);
+  } else if (key == m_currentProxyKey && !m_currentImageShown &&
+             !m_currentProxyShown) {
+    m_currentProxyShown = true;
+    showDecodedImage(key.path, imagePixmap, imageInfo);
+
+    if (isRaw(key.path) && std::max(imagePixmap.width(),
+                                    imagePixmap.height()) <
+                               MIN_USEFUL_PREVIEW_SIZE) {
+      requestFullResolution();
+    }
+  }
+}
+
+void ImageLoader::onPartialImage(const ImageCacheKey &key,
+                                 const QPixmap &imagePixmap,
+                                 const ImageInfo &imageInfo) {
+  /// Only while nothing better of the current image is on screen.
+  /// Partials come in order, each covers more than the previous one
+  if ((key == m_currentImageKey || key == m_currentProxyKey) &&
+      !m_currentImageShown && !m_currentProxyShown) {
+    showDecodedImage(key.path, imagePixmap, imageInfo);
+  }
+}
+
+void ImageLoader::onDecodeDropped(const ImageCacheKey &key,
+                                  const DecodePool::Ticket &ticket) {
+  if (m_pendingDecodes.value(key) == ticket) {
+    m_pendingDecodes.remove(key);
+  }
+
+  if (key == m_clipboardKey) {
+    m_clipboardKey = {};
+  }
+}
+
+void ImageLoader::showDecodedImage(const QString &imagePath,
+                                   const QPixmap &imagePixmap,
+                                   const ImageInfo &imageInfo) {
+  m_currentImageInfo = imageInfo;
+
+  /// A late slideshow frame gets its full period from now,
+  /// once all of it is on screen
+  if (!imageInfo.partial) {
+    resumeSlideshow();
+  }
+
+  /// Ends in the window, covers the wait in its event queue
+  Trace::asyncBegin("ui", "show image", qHash(imagePath));
+  emit imageLoaded(QFileInfo(imagePath), imagePixmap, imageInfo);
+}
+
+void ImageLoader::showCurrentImage() {
+  /// Anything queued for images we have moved past is now stale
+  m_decodePool.advanceGeneration();
+
+  const auto &imagePath = m_imageFiles.path(m_currentIndex);
+  m_currentImageKey = cacheKeyFor(m_currentIndex, m_decodeOptions);
+  m_currentImageShown = false;
+  m_currentImageWanted = true;
+  m_currentProxyKey = {};
+  m_currentProxyShown = false;
+
+  DecodeOptions proxyOptions;
+  if (const auto *cached = m_imageCache.find(m_currentImageKey)) {
+    m_currentImageShown = true;
+    showDecodedImage(imagePath, cached->pixmap, cached->info);
+  } else if (proxyOptionsFor(imagePath, proxyOptions)) {
+    /// Show a reduced version first, either the embedded RAW
+    /// preview or a decode at screen resolution. The full
+    /// decode waits until zooming needs it
+    m_currentProxyKey = cacheKeyFor(m_currentIndex, proxyOptions);
+
+    if (const auto *proxy = m_imageCache.find(m_currentProxyKey)) {
+      m_currentProxyShown = true;
+      showDecodedImage(imagePath, proxy->pixmap, proxy->info);
+    } else {
+      requestDecode(m_currentProxyKey, proxyOptions, PROXY_PRIORITY);
+    }
+
+    m_currentImageWanted = fullDecodeFollowsProxy(imagePath);
+    if (m_currentImageWanted) {
+      requestDecode(m_currentImageKey, m_decodeOptions,
+                    CURRENT_IMAGE_PRIORITY);
+    }
+  } else {
+    requestDecode(m_currentImageKey, m_decodeOptions, CURRENT_IMAGE_PRIORITY);
+  }
+
+  prefetchAroundCurrentImage();
+}
+
+void ImageLoader::requestFullResolution() {
+  if (m_currentProxyKey.path.isEmpty() || m_currentImageShown) {
+    /// Already showing the full decode
+    return;
+  }
+
+  m_currentImageWanted = true;
+  if (const auto *cached = m_imageCache.find(m_currentImageKey)) {
+    /// Decoded for the clipboard earlier
+    m_currentImageShown = true;
+    showDecodedImage(m_currentImageKey.path, cached->pixmap, cached->info);
+    return;
+  }
+  requestDecode(m_currentImageKey, m_decodeOptions, CURRENT_IMAGE_PRIORITY);
+}
+
+void ImageLoader::prefetchAroundCurrentImage() {
+  /// Never prefetch more than the cache can hold, or the
+  /// prefetched images would evict each other
+  const auto memoryCeiling =
+      std::min(m_prefetchMemoryBytes, m_imageCache.budget());
+
+  /// Frame sizes are unknown until decoded, so estimate
+  /// from the most recent decode
+  qint64 plannedBytes = m_lastFrameBytes;
+
+  /// A slideshow plans by its deadlines, wrapping around when it loops
+  const auto plan =
+      m_slideshow.isRunning()
+          ? m_slideshow.plan(m_currentIndex, m_imageFiles.size())
+          : m_prefetchWindow.plan(m_currentIndex, m_imageFiles.size());
+
+  int priority = PREFETCH_PRIORITY;
+  for (auto index : plan) {
+    plannedBytes += m_lastFrameBytes;
+    if (plannedBytes > memoryCeiling) {
+      break;
+    }
+
+    const auto &imagePath = m_imageFiles.path(index);
+
+    auto fullKey = cacheKeyFor(index, m_decodeOptions);
+    if (m_imageCache.contains(fullKey)) {
+      --priority;
+      continue;
+    }
+
+    /// Unless the full decode follows anyway, the proxy
+    /// is all that is shown on arrival
+    DecodeOptions proxyOptions;
+    if (!fullDecodeFollowsProxy(imagePath) &&
+        proxyOptionsFor(imagePath, proxyOptions)) {
+      auto proxyKey = cacheKeyFor(index, proxyOptions);
+      if (!m_imageCache.contains(proxyKey)) {
+        requestDecode(proxyKey, proxyOptions, priority);
+      }
+    } else {
+      requestDecode(fullKey, m_decodeOptions, priority);
+    }
+    --priority;
+  }
+}
+
+bool ImageLoader::isDecoded(std::size_t index) const {
+  if (m_imageCache.contains(cacheKeyFor(index, m_decodeOptions))) {
+    return true;
+  }
+  DecodeOptions proxyOptions;
+  return proxyOptionsFor(m_imageFiles.path(index), proxyOptions) &&
+         m_imageCache.contains(cacheKeyFor(index, proxyOptions));
+}
+
+void ImageLoader::loadImage(const QString &imagePath) {
+
+  QFileInfo fileInfo(imagePath);
+
+  loadImagePathsIfEmpty(fileInfo.dir().absolutePath(),
+                        fileInfo.absoluteFilePath());
+
+  if (m_imageFiles.empty()) {
+    return;
+  }
+
+  showCurrentImage();
 }
 
 void ImageLoader::goToStart() {
   m_currentIndex = 0;
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  loadImage(m_imageFiles.path(m_currentIndex));
 }
 
 bool ImageLoader::hasPrevious() const {
-  return m_imageFilePaths.size() > 0 && (m_currentIndex >= 1);
+  return m_imageFiles.size() > 0 && (m_currentIndex >= 1);
 }
 
 void ImageLoader::goBackward() {
+  endSlideshow();
+  m_prefetchWindow.recordStep(-10);
+
   if (m_currentIndex >= 10) {
     m_currentIndex -= 10;
   } else {
     m_currentIndex = 0;
   }
 
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  loadImage(m_imageFiles.path(m_currentIndex));
 }
 
-void ImageLoader::previousImage(const QPixmap &currentPixmap) {
-  if (hasPrevious()) {
-    m_nextPixmap = currentPixmap;
-    m_nextImageInfo = m_currentImageInfo;
-    m_currentImageInfo = m_previousImageInfo;
+void ImageLoader::previousImage() {
+  endSlideshow();
 
+  if (hasPrevious()) {
     m_currentIndex -= 1;
-    QFileInfo fileInfo(m_imageFilePaths[m_currentIndex]);
-
-    emit imageLoaded(fileInfo, m_previousPixmap, m_previousImageInfo);
-
-    if (m_currentIndex >= 1) {
-      m_previousImageInfo = loadImageIntoPixmap(
-          m_imageFilePaths[m_currentIndex - 1], m_previousPixmap);
-    }
+    m_prefetchWindow.recordStep(-1);
+    showCurrentImage();
   }
 }
 
 bool ImageLoader::hasNext() const {
-  return (m_imageFilePaths.size() > 0 &&
-          m_currentIndex + 1 < m_imageFilePaths.size());
+  return (m_imageFiles.size() > 0 &&
+          m_currentIndex + 1 < m_imageFiles.size());
 }
 
-void ImageLoader::nextImage(const QPixmap &currentPixmap) {
-  if (hasNext()) {
-    m_previousPixmap = currentPixmap;
-    m_previousImageInfo = m_currentImageInfo;
-    m_currentImageInfo = m_nextImageInfo;
+void ImageLoader::nextImage() {
+  endSlideshow();
 
+  if (hasNext()) {
     m_currentIndex += 1;
-    QFileInfo fileInfo(m_imageFilePaths[m_currentIndex]);
-
-    emit imageLoaded(fileInfo, m_nextPixmap, m_nextImageInfo);
-
-    if (m_currentIndex + 1 < m_imageFilePaths.size()) {
-      m_nextImageInfo = loadImageIntoPixmap(
-          m_imageFilePaths[m_currentIndex + 1], m_nextPixmap);
-    }
+    m_prefetchWindow.recordStep(1);
+    showCurrentImage();
   }
 }
 
 void ImageLoader::goForward() {
+  endSlideshow();
+  m_prefetchWindow.recordStep(10);
+
   m_currentIndex += 10;
 
-  const auto maxImageFiles = m_imageFilePaths.size() - 1;
+  const auto maxImageFiles = m_imageFiles.size() - 1;
 
   if (m_currentIndex > maxImageFiles) {
     m_currentIndex = maxImageFiles;
   }
 
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  loadImage(m_imageFiles.path(m_currentIndex));
 }
 
 void ImageLoader::copyCurrentImageFullResToClipboard() {
-  auto imagePath = m_imageFilePaths[m_currentIndex];
+  if (m_imageFiles.empty()) {
+    return;
+  }
 
-  QPixmap imagePixmap;
-  m_currentImageInfo = loadImageIntoPixmap(imagePath, imagePixmap);
+  if (const auto *cached = m_imageCache.find(m_currentImageKey)) {
+    m_clipboardKey = {};
+    emit fullResolutionImageCopied(cached->pixmap);
+    return;
+  }
 
-  QClipboard *clipboard = QGuiApplication::clipboard();
-  clipboard->setPixmap(imagePixmap);
+  /// Only a proxy is decoded so far. The copy completes once the full
+  /// decode arrives, unless the user moves on before that
+  m_clipboardKey = m_currentImageKey;
+  requestDecode(m_currentImageKey, m_decodeOptions, CURRENT_IMAGE_PRIORITY);
 }
 
-void ImageLoader::slideShowNext(const QPixmap &currentPixmap, bool loop) {
-  if (hasNext()) {
-    nextImage(currentPixmap);
-  } else {
-    /// No more images left
+void ImageLoader::slideShowStart(int periodMs, bool loop) {
+  if (m_imageFiles.empty()) {
+    emit slideShowEnded();
+    return;
+  }
 
-    /// Check if slideshow is configured to loop
-    if (loop) {
-      /// Restart slideshow
-      goToStart();
-    }
+  m_prefetchWindow.setSlideshowRunning(true);
+  m_slideshow.start(m_clock.elapsed(), periodMs, loop);
+
+  /// The frames after this one start decoding now, a full
+  /// period before the first of them is due
+  prefetchAroundCurrentImage();
+  armSlideshowTimer();
+}
+
+void ImageLoader::slideShowStop() {
+  /// The window asked for it, and an answer arriving after a
+  /// restart would make it think the new slideshow had ended
+  endSlideshow(false);
+}
+
+void ImageLoader::slideShowSetPeriod(int periodMs) {
+  m_slideshow.setPeriod(periodMs);
+  armSlideshowTimer();
+}
+
+void ImageLoader::slideShowSetLoop(bool loop) {
+  m_slideshow.setLoop(loop);
+  if (m_slideshow.isRunning()) {
+    prefetchAroundCurrentImage();
+  }
+}
+
+void ImageLoader::armSlideshowTimer() {
+  if (!m_slideshow.isRunning() || m_slideshow.isWaiting()) {
+    return;
+  }
+  m_slideshowTimer->start(
+      std::max<qint64>(0, m_slideshow.nextDeadline() - m_clock.elapsed()));
+}
+
+void ImageLoader::onSlideshowDeadline() {
+  Trace::Span span("slideshow", "deadline");
+
+  std::size_t next = 0;
+  if (!m_slideshow.next(m_currentIndex, m_imageFiles.size(), next)) {
+    endSlideshow();
+    return;
+  }
+
+  const bool ready = isDecoded(next);
+  m_slideshow.frameDue(m_clock.elapsed(), ready);
+  if (!ready) {
+    /// Shown once decoded, see showDecodedImage
+    Trace::asyncBegin("slideshow", "late frame", next);
+    Trace::counter("slideshow", "missed deadlines",
+                   m_slideshow.missedDeadlines());
+  }
+
+  m_prefetchWindow.recordStep(1);
+  m_currentIndex = next;
+  showCurrentImage();
+  armSlideshowTimer();
+}
+
+void ImageLoader::resumeSlideshow() {
+  if (!m_slideshow.isWaiting()) {
+    return;
+  }
+  Trace::asyncEnd("slideshow", "late frame", m_currentIndex);
+  m_slideshow.frameShown(m_clock.elapsed());
+  armSlideshowTimer();
+}
+
+void ImageLoader::endSlideshow(bool notifyWindow) {
+  m_prefetchWindow.setSlideshowRunning(false);
+  if (!m_slideshow.isRunning()) {
+    return;
+  }
+
+  m_slideshowTimer->stop();
+  m_slideshow.stop();
+  if (notifyWindow) {
+    emit slideShowEnded();
   }
 }
 
 void ImageLoader::deleteCurrentImage(const QFileInfo &fileInfo) {
 
-  auto it = std::find(m_imageFilePaths.begin(), m_imageFilePaths.end(),
-                      fileInfo.absoluteFilePath());
-  int index = (it != m_imageFilePaths.end())
-                  ? std::distance(m_imageFilePaths.begin(), it)
-                  : -1;
+  auto index = m_imageFiles.indexOf(fileInfo.absoluteFilePath());
 
   // Make sure that the index is same as m_currentIndex
-  if (index != -1 && static_cast<std::size_t>(index) == m_currentIndex) {
-    auto imagePath = m_imageFilePaths[m_currentIndex];
+  if (index && *index == m_currentIndex) {
+    auto imagePath = m_imageFiles.path(m_currentIndex);
 
     // Delete image
     QFile file(imagePath);
     file.moveToTrash();
 
     // Delete path from tracked list of paths
-    m_imageFilePaths.erase(std::remove(m_imageFilePaths.begin(),
-                                       m_imageFilePaths.end(), imagePath),
-                           m_imageFilePaths.end());
+    m_imageFiles.remove(m_currentIndex);
+    m_imageCache.remove(imagePath);
+    emit imageFilesRemoved({imagePath});
 
     // if possible, move to next image
-    if (m_imageFilePaths.size() > 0 &&
-        m_currentIndex <= m_imageFilePaths.size() - 1) {
+    if (m_imageFiles.size() > 0 &&
+        m_currentIndex <= m_imageFiles.size() - 1) {
 
       /// more images available
       /// currentIndex now points to the "next" image that
       /// should be shown
       /// no change needed to index
 
-      /// This new image is what used to be nextPixmap
-      /// So just emit that and update newPixmap
-      /// previousPixmap remains the same
-
-      QFileInfo fileInfo(m_imageFilePaths[m_currentIndex]);
-
-      // Emit nextPixmap as current pixmap
-      emit imageLoaded(fileInfo, m_nextPixmap, m_nextImageInfo);
-
-      m_currentImageInfo = m_nextImageInfo;
-
-      if (m_currentIndex + 1 < m_imageFilePaths.size()) {
-        // Prefetch load a new image into nextPixmap
-        m_nextImageInfo = loadImageIntoPixmap(
-            m_imageFilePaths[m_currentIndex + 1], m_nextPixmap);
-      }
-    } else if (m_imageFilePaths.size() > 0) {
+      /// This new image was prefetched as next, so it
+      /// is usually shown straight from the cache
+      showCurrentImage();
+    } else if (m_imageFiles.size() > 0) {
       /// Previous condition was not true
 
-      /// At least one more image available in m_imageFilePaths
+      /// At least one more image available in m_imageFiles
       /// We were at the last image in the list
 
-      /// Set the previous pixmap as the new current
-
+      /// Show the previous image as the new current
       m_currentIndex -= 1;
-
-      QFileInfo fileInfo(m_imageFilePaths[m_currentIndex]);
-
-      // Emit previousPixmap as current pixmap
-      emit imageLoaded(fileInfo, m_previousPixmap, m_previousImageInfo);
-
-      m_currentImageInfo = m_previousImageInfo;
-
-      // Prefetch load a new image into previousPixmap
-      m_previousImageInfo = loadImageIntoPixmap(
-          m_imageFilePaths[m_currentIndex - 1], m_previousPixmap);
+      showCurrentImage();
 
     } else {
       emit noMoreImagesLeft();
     }
   } else {
     /// TODO: Something wrong
-    qDebug() << index << " " << m_currentIndex;
+    qDebug() << (index ? static_cast<qint64>(*index) : -1) << " "
+             << m_currentIndex;
   }
 }
 
-// Comparison function for sorting QString objects by name
-bool ImageLoader::compareFilePathsByName(const QString &a, const QString &b) {
-  return a.compare(b, Qt::CaseInsensitive) < 0;
-}
-
-// Comparison function for sorting QString objects by size
-bool ImageLoader::compareFilePathsBySize(const QString &a, const QString &b) {
-  QFileInfo fileInfoA(a);
-  QFileInfo fileInfoB(b);
-  return fileInfoA.size() < fileInfoB.size();
-}
-
-// Comparison function for sorting QString objects by date modified
-bool ImageLoader::compareFilePathsByDateModified(const QString &a,
-                                                 const QString &b) {
-  QFileInfo fileInfoA(a);
-  QFileInfo fileInfoB(b);
-  return fileInfoA.lastModified() < fileInfoB.lastModified();
-}
-
 void ImageLoader::updateCurrentIndexAfterSort(const QString &currentImagePath) {
-  auto it = std::find(m_imageFilePaths.begin(), m_imageFilePaths.end(),
-                      currentImagePath);
-  int index = (it != m_imageFilePaths.end())
-                  ? std::distance(m_imageFilePaths.begin(), it)
-                  : -1;
+  auto index = m_imageFiles.indexOf(currentImagePath);
 
-  if (index == -1) {
+  if (!index) {
     // bad
   } else {
-    m_currentIndex = index;
+    m_currentIndex = *index;
   }
 }
 
-void ImageLoader::sortAscending(const ImageLoader::SortFunction &compare_fn) {
-  const auto currentImagePath = m_imageFilePaths[m_currentIndex];
-
-  // Sort ascending order
-  std::sort(m_imageFilePaths.begin(), m_imageFilePaths.end(), compare_fn);
-
-  // update m_currentIndex
-  m_currentIndex = 0;
-  /// updateCurrentIndexAfterSort(currentImagePath);
-
-  // loadImage and prefetch new next/prev images
-  loadImage(m_imageFilePaths[m_currentIndex]);
-}
-
-void ImageLoader::sortDescending(const ImageLoader::SortFunction &compare_fn) {
-  const auto currentImagePath = m_imageFilePaths[m_currentIndex];
-
-  // Sort descending order
-  std::sort(m_imageFilePaths.rbegin(), m_imageFilePaths.rend(), compare_fn);
-
-  // update m_currentIndex
-  m_currentIndex = 0;
-  /// updateCurrentIndexAfterSort(currentImagePath);
-
-  // loadImage and prefetch new next/prev images
-  loadImage(m_imageFilePaths[m_currentIndex]);
-}
-
 void ImageLoader::sort() {
   /// Sort image file paths based on
-  /// m_currentSortOrderAscending and m_currentSortByType
-
-  ImageLoader::SortFunction fn;
-  if (m_currentSortByType == SortBy::name) {
-    fn = compareFilePathsByName;
-  } else if (m_currentSortByType == SortBy::size) {
-    fn = compareFilePathsBySize;
-  } else if (m_currentSortByType == SortBy::date_modified) {
-    fn = compareFilePathsByDateModified;
+  /// m_currentSortOrder and m_currentSortByType
+  if (m_imageFiles.empty()) {
+    return;
   }
 
-  if (fn) {
-    if (m_currentSortOrder == SortOrder::ascending) {
-      sortAscending(fn);
-    } else {
-      sortDescending(fn);
-    }
-  }
+  const auto currentImagePath = m_imageFiles.path(m_currentIndex);
+
+  /// Sorts over the keys cached in the index, no stat calls
+  m_imageFiles.sort(m_currentSortByType, m_currentSortOrder);
+  emit imageFilesSorted(std::make_shared<const ImageFileIndex>(m_imageFiles));
+
+  /// Stay on the image being viewed, it is already
+  /// on screen. Only its neighbours have changed
+  updateCurrentIndexAfterSort(currentImagePath);
+  prefetchAroundCurrentImage();
 }
 
 void ImageLoader::changeSortOrder(SortOrder order) {
@@ -438,17 +1446,63 @@ void ImageLoader::changeSortBy(SortBy type) {
   }
 }
 
+void ImageLoader::updateDecodeOptions() {
+  /// Decodes made with the old options no longer match any cache
+  /// key and age out of the cache. Queued RAW decodes see the new
+  /// version and are dropped before they start
+  auto options = DecodeOptions::fromPreferences();
+  options.version = m_decodeOptions.version + 1;
+  m_decodeOptions = options;
+  m_decodeOptionsVersion.store(options.version);
+
+  /// Those dropped decodes must not stand in for new requests
+  /// of the same key, as when a setting is switched back
+  for (auto it = m_pendingDecodes.begin(); it != m_pendingDecodes.end();) {
+    it = isRaw(it.key().path) ? m_pendingDecodes.erase(it) : std::next(it);
+  }
+
+  m_rawPreviewMode = Preferences::get(Preferences::SETTING_RAW_PREVIEW_MODE,
+                                      Preferences::RAW_PREVIEW_THEN_FULL)
+                         .toInt();
+
+  reloadCurrentImage();
+}
+
 void ImageLoader::reloadCurrentImage() {
+  if (m_imageFiles.empty()) {
+    return;
+  }
+
+  /// Settings may have changed
+  m_screenResolutionDecode =
+      Preferences::get(Preferences::SETTING_SCREEN_RESOLUTION_DECODE, true)
+          .toBool();
+
   /// Reload this image
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  loadImage(m_imageFiles.path(m_currentIndex));
 }
 
 void ImageLoader::goToFirstImage() {
   m_currentIndex = 0;
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  loadImage(m_imageFiles.path(m_currentIndex));
 }
 
 void ImageLoader::goToLastImage() {
-  m_currentIndex = m_imageFilePaths.size() - 1;
-  loadImage(m_imageFilePaths[m_currentIndex]);
+  m_currentIndex = m_imageFiles.size() - 1;
+  loadImage(m_imageFiles.path(m_currentIndex));
+}
+
+void ImageLoader::goToImage(const QString &imagePath) {
+  auto index = m_imageFiles.indexOf(imagePath);
+  if (!index || *index == m_currentIndex) {
+    return;
+  }
+
+  /// A jump picked from the thumbnails, in whichever direction it went
+  endSlideshow();
+  m_prefetchWindow.recordStep(static_cast<long>(*index) -
+                              static_cast<long>(m_currentIndex));
+
+  m_currentIndex = *index;
+  showCurrentImage();
 }
\ No newline at end of file
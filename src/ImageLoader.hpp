@@ -12,71 +12,220 @@
 #include <QFile>
 #include <QColorSpace>
 #include <QGuiApplication>
-#include <QClipboard>
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QBuffer>
 
+#include "DecodeOptions.hpp"
+#include "DecodePool.hpp"
+#include "DiskCache.hpp"
+#include "ExifReader.hpp"
+#include "FolderWatcher.hpp"
+#include "ImageCache.hpp"
+#include "ImageFileIndex.hpp"
 #include "ImageInfo.hpp"
+#include "MappedFile.hpp"
+#include "PixelKernels.hpp"
 #include "Preferences.hpp"
+#include "PrefetchWindow.hpp"
+#include "RawProcessorPool.hpp"
+#include "SlideshowScheduler.hpp"
 #include "SortOptions.hpp"
+#include "Trace.hpp"
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
+/// Lists the image files of a directory on the calling thread and hands
+/// them over in batches, see ImageLoader::FIRST_SCAN_BATCH
+void scanImageFiles(
+    const QString &directory, const QString &skipPath,
+    const std::atomic<bool> &cancelled,
+    const std::function<void(std::vector<QString> batch, bool finished)>
+        &onBatch);
+
 class ImageLoader : public QObject {
   Q_OBJECT
- 
-  LibRaw m_rawProcessor;
 
-  std::vector<QString> m_imageFilePaths;
+  /// QThreadPool runs higher priorities first. Prefetches count down
+  /// from PREFETCH_PRIORITY in the order PrefetchWindow plans them
+  static constexpr inline int PROXY_PRIORITY = 1001;
+  static constexpr inline int CURRENT_IMAGE_PRIORITY = 1000;
+  static constexpr inline int PREFETCH_PRIORITY = 999;
+
+  /// Embedded previews smaller than this are only thumbnails,
+  /// so the full decode is started right away
+  static constexpr inline int MIN_USEFUL_PREVIEW_SIZE = 1280;
+
+  /// Images above this are drawn as tiles when zoomed in
+  /// instead of being decoded at full resolution
+  static constexpr inline qint64 TILED_MIN_PIXELS = 100'000'000;
+
+  /// The current image is read in chunks and shown in parts while it
+  /// loads when its first chunk shows the whole read will take longer
+  /// than the interval. Smaller files and fast storage decode from the
+  /// mapping in one go. Only JPEG decodes a truncated file, other
+  /// formats are read in chunks without partials. Each partial decodes
+  /// the whole prefix again, so a load shows a few at most
+  static constexpr inline qint64 PROGRESSIVE_MIN_BYTES = 1024 * 1024;
+  static constexpr inline qint64 PROGRESSIVE_CHUNK_BYTES = 256 * 1024;
+  static constexpr inline qint64 PROGRESSIVE_INTERVAL_MS = 200;
+  static constexpr inline int PROGRESSIVE_MAX_PARTIALS = 4;
+  static constexpr inline qint64 PAGE_BYTES = 4096;
+
+  /// Directory walk in the background, set the flag to cancel it
+  QThreadPool m_scanPool;
+  std::shared_ptr<std::atomic<bool>> m_directoryScan;
+
+  /// Changes to the open folder, applied as they happen. Files the
+  /// watcher reports while a scan runs are left out of later batches
+  FolderWatcher *m_folderWatcher;
+  QSet<QString> m_changedDuringScan;
+
+  /// Disk cache entries of fresh decodes, written after they are
+  /// shown. Declared first, decode workers start jobs on it until
+  /// m_decodePool is gone
+  QThreadPool m_diskCachePool;
+  DecodePool m_decodePool;
+  QHash<ImageCacheKey, DecodePool::Ticket> m_pendingDecodes;
+
+  ImageFileIndex m_imageFiles;
   std::size_t m_currentIndex{0};
 
-  QPixmap m_previousPixmap;
-  QPixmap m_nextPixmap;
+  ImageCache m_imageCache;
+  DecodeOptions m_decodeOptions;
+
+  /// Version of the latest options snapshot, read by the workers
+  std::atomic<quint32> m_decodeOptionsVersion{0};
+  int m_rawPreviewMode{Preferences::RAW_PREVIEW_THEN_FULL};
+  bool m_screenResolutionDecode{true};
+  QSize m_viewportSize;
 
+  PrefetchWindow m_prefetchWindow;
+
+  /// Decodes ahead of the slideshow's deadlines and advances it. The
+  /// timer runs on the loader thread, next to the cache it checks
+  SlideshowScheduler m_slideshow;
+  QTimer *m_slideshowTimer;
+  QElapsedTimer m_clock;
+  qint64 m_prefetchMemoryBytes{0};
+  qint64 m_lastFrameBytes{0};
+
+  ImageCacheKey m_currentImageKey;
+  bool m_currentImageShown{false};
+  /// The view asked for the full decode, not only the clipboard
+  bool m_currentImageWanted{false};
+
+  /// Set while a reduced stand-in can be shown for the current image
+  ImageCacheKey m_currentProxyKey;
+  bool m_currentProxyShown{false};
   ImageInfo m_currentImageInfo;
-  ImageInfo m_previousImageInfo;
-  ImageInfo m_nextImageInfo;
+
+  /// Full decode waited on for a copy to the clipboard, empty if none
+  ImageCacheKey m_clipboardKey;
 
   SortOrder m_currentSortOrder{SortOrder::ascending};
   SortBy m_currentSortByType{SortBy::name};
 
-  void loadImagePathsIfEmpty(const char* directory, const char* current_file);
-  ImageInfo loadRaw(const QString &imagePath, QPixmap& imagePixmap);
-  ImageInfo loadWithImageReader(const QString &imagePath, QPixmap& imagePixmap);
-  ImageInfo loadImageIntoPixmap(const QString &imagePath, QPixmap& imagePixmap);
+  void loadImagePathsIfEmpty(const QString &directory, const QString &currentFile);
+  void startDirectoryScan(const QString &directory, const QString &skipPath);
+  void cancelDirectoryScan();
+  void onScanBatch(const std::shared_ptr<std::atomic<bool>> &scan, ImageFileIndex batch, bool finished);
+  void onFilesWritten(const QStringList &paths);
+  void onFilesRemoved(const QStringList &paths);
+  void onFilesRenamed(const QStringList &from, const QStringList &to);
+  void insertImageFiles(ImageFileIndex batch);
+  static QImage wrapProcessedImage(libraw_processed_image_t *processed);
+  static ImageInfo loadRaw(const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap);
+  static ImageInfo loadRawPreview(const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap);
+  static ImageInfo loadWithImageReader(const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap);
+  static ImageInfo readWithImageReader(QImageReader &imageReader, const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap);
+  static ImageInfo loadProgressively(const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap,
+                                     const std::function<bool()> &isStale,
+                                     const std::function<void(const QPixmap &, const ImageInfo &)> &onPartial);
+  static void rememberInDiskCache(const QString &imagePath, qint64 lastModified, const QPixmap &imagePixmap, const ImageInfo &imageInfo);
+  ImageCacheKey cacheKeyFor(std::size_t index, const DecodeOptions &options) const;
+  bool proxyOptionsFor(const QString &imagePath, DecodeOptions &options) const;
+  bool fullDecodeFollowsProxy(const QString &imagePath) const;
+  void showCurrentImage();
+  void showDecodedImage(const QString &imagePath, const QPixmap &imagePixmap, const ImageInfo &imageInfo);
+  void prefetchAroundCurrentImage();
+  bool isDecoded(std::size_t index) const;
+  void armSlideshowTimer();
+  void onSlideshowDeadline();
+  void resumeSlideshow();
+  void endSlideshow(bool notifyWindow = true);
+  void requestDecode(const ImageCacheKey &key, const DecodeOptions &options, int priority);
+  void onImageDecoded(const ImageCacheKey &requestKey, const DecodePool::Ticket &ticket,
+                      const ImageCacheKey &key, const QPixmap &imagePixmap,
+                      const ImageInfo &imageInfo, qint64 decodeMs);
+  void onPartialImage(const ImageCacheKey &key, const QPixmap &imagePixmap, const ImageInfo &imageInfo);
+  void onDecodeDropped(const ImageCacheKey &key, const DecodePool::Ticket &ticket);
   void updateCurrentIndexAfterSort(const QString& currentImagePath);
-  
-  static bool compareFilePathsByName(const QString &a, const QString &b);
-  static bool compareFilePathsBySize(const QString &a, const QString &b);
-  static bool compareFilePathsByDateModified(const QString &a, const QString &b);
-
-  typedef std::function<bool(const QString &, const QString &)> SortFunction;
-  void sortAscending(const SortFunction& compare_fn);
-  void sortDescending(const SortFunction& compare_fn);
   void sort();
 
 public:
+  /// Directory scans hand over files in batches growing from
+  /// the first size to the maximum
+  static constexpr inline std::size_t FIRST_SCAN_BATCH = 256;
+  static constexpr inline std::size_t MAX_SCAN_BATCH = 65536;
+
   ImageLoader();
+  ~ImageLoader();
   bool hasNext() const;
   bool hasPrevious() const;
 
+  static bool isRaw(const QString &imagePath);
+
+  /// Thread-safe, also used by the thumbnail workers
+  static ImageInfo loadImageIntoPixmap(const QString &imagePath, const DecodeOptions &options, QPixmap& imagePixmap);
+
 public slots:
   void resetImageFilePaths();
+  void updateCacheBudget();
+  void updatePrefetchWindow();
+  void setViewportSize(const QSize &size);
   void loadImage(const QString &imagePath);
   void goToStart();
   void goBackward();
-  void previousImage(const QPixmap &currentPixmap);
-  void nextImage(const QPixmap &currentPixmap);
+  void previousImage();
+  void nextImage();
   void goForward();
   void deleteCurrentImage(const QFileInfo& fileInfo);
   void changeSortOrder(SortOrder order);
   void changeSortBy(SortBy type);
   void copyCurrentImageFullResToClipboard();
-  void slideShowNext(const QPixmap& currentPixmap, bool loop);
+  void slideShowStart(int periodMs, bool loop);
+  void slideShowStop();
+  void slideShowSetPeriod(int periodMs);
+  void slideShowSetLoop(bool loop);
   void reloadCurrentImage();
+  void updateDecodeOptions();
+  void requestFullResolution();
   void goToFirstImage();
   void goToLastImage();
+  void goToImage(const QString &imagePath);
 
 signals:
   void imageLoaded(const QFileInfo& imageFileInfo, const QPixmap &imagePixmap, const ImageInfo& imageInfo);
   void noMoreImagesLeft();
+  /// The list was replaced, e.g. by the files of another folder
+  void imageFilesChanged(const ImageFileIndex::Snapshot &imageFiles);
+
+  /// Changes to the list already published, so views can keep
+  /// their scroll position and selection
+  void imageFilesSorted(const ImageFileIndex::Snapshot &imageFiles);
+  void imageFilesInserted(const ImageFileIndex &batch, SortBy by,
+                          SortOrder order);
+  void imageFilesRemoved(const QStringList &paths);
+  void fullResolutionImageCopied(const QPixmap &imagePixmap);
+
+  /// The slideshow reached the end without looping, or navigation took over
+  void slideShowEnded();
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "ImageMimeData.hpp"
+#include <QBuffer>
+#include <QImage>
+
+namespace {
+constexpr char IMAGE_MIME_TYPE[] = "application/x-qt-image";
+constexpr char PNG_MIME_TYPE[] = "image/png";
+} // namespace
+
+ImageMimeData::ImageMimeData(const QPixmap &pixmap) : m_pixmap(pixmap) {}
+
+QStringList ImageMimeData::formats() const {
+  return {IMAGE_MIME_TYPE, PNG_MIME_TYPE};
+}
+
+bool ImageMimeData::hasFormat(const QString &mimeType) const {
+  return mimeType == IMAGE_MIME_TYPE || mimeType == PNG_MIME_TYPE;
+}
+
+QVariant ImageMimeData::retrieveData(const QString &mimeType,
+                                     QMetaType type) const {
+  if (mimeType == IMAGE_MIME_TYPE) {
+    /// The platform plugin converts to what the pasting
+    /// application asked for
+    return m_pixmap.toImage();
+  }
+
+  if (mimeType == PNG_MIME_TYPE) {
+    if (m_png.isEmpty()) {
+      QBuffer buffer(&m_png);
+      buffer.open(QIODevice::WriteOnly);
+      m_pixmap.toImage().save(&buffer, "PNG");
+    }
+    return m_png;
+  }
+
+  return QMimeData::retrieveData(mimeType, type);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include <QByteArray>
+#include <QMimeData>
+#include <QPixmap>
+#include <QStringList>
+#include <QVariant>
+
+/// Clipboard contents for a copied image that encode nothing up front.
+///
+/// Holding the pixmap only shares its pixel data. The image is converted
+/// or encoded as PNG once another application asks for it, and kept for
+/// any later paste.
+class ImageMimeData : public QMimeData {
+  QPixmap m_pixmap;
+  mutable QByteArray m_png;
+
+public:
+  explicit ImageMimeData(const QPixmap &pixmap);
+
+  QStringList formats() const override;
+  bool hasFormat(const QString &mimeType) const override;
+
+protected:
+  QVariant retrieveData(const QString &mimeType,
+                        QMetaType type) const override;
+};
\ No newline at end of file
@@ -3,24 +3,27 @@
 ImageViewer::ImageViewer(QWidget *parent) : QGraphicsView(parent) {
   setScene(&m_scene);
   m_scene.addItem(&m_item);
+  m_scene.addItem(&m_tiledItem);
   setDragMode(QGraphicsView::ScrollHandDrag);
   setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
   setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
   setResizeAnchor(QGraphicsView::AnchorViewCenter);
   setStyleSheet("background: transparent;");
+
+  connect(&m_animation, &AnimationPlayer::frameReady, this,
+          [this](const QPixmap &frame) { m_item.setFrame(frame); });
 }
 
 void ImageViewer::setPixmap(const QPixmap &pixmap, int desiredWidth,
                             int desiredHeight) {
   // Reset transformation before setting the new pixmap
   m_item.resetTransform();
+  m_tiledItem.clear();
+  m_animation.stop();
 
-  // Set the QGraphicsPixmapItem's pixmap
+  // Set the pixmap, the item resamples it once per zoom level
   m_item.setPixmap(pixmap);
 
-  // Enable smooth transformation by setting interpolation mode
-  m_item.setTransformationMode(Qt::SmoothTransformation);
-
   // Calculate the scale factors to achieve the desired width and height while
   // maintaining aspect ratio
   if (pixmap.width() > desiredWidth || pixmap.height() > desiredHeight) {
@@ -45,9 +48,60 @@ void ImageViewer::setPixmap(const QPixmap &pixmap, int desiredWidth,
                        pixmap.width(), pixmap.height());
 }
 
+void ImageViewer::replacePixmap(const QPixmap &pixmap) {
+  const auto previous = m_item.pixmap();
+  if (previous.isNull() || pixmap.isNull()) {
+    setPixmap(pixmap, width(), height());
+    return;
+  }
+
+  // Keep the same part of the image under the same
+  // point of the view, at the same on-screen size
+  const qreal ratio = static_cast<qreal>(previous.width()) / pixmap.width();
+  const QPointF center = mapToScene(viewport()->rect().center());
+
+  m_tiledItem.clear();
+  m_animation.stop();
+  m_item.setPixmap(pixmap);
+
+  auto offset = -QRectF(pixmap.rect()).center();
+  m_item.setOffset(offset);
+  m_scene.setSceneRect(-pixmap.width() / 2.0, -pixmap.height() / 2.0,
+                       pixmap.width(), pixmap.height());
+
+  QGraphicsView::scale(ratio, ratio);
+  centerOn(center / ratio);
+}
+
+void ImageViewer::setTiledSource(const QString &imagePath,
+                                 const QSize &imageSize) {
+  const auto &proxy = m_item.pixmap();
+  if (proxy.isNull() || imageSize.isEmpty()) {
+    return;
+  }
+
+  // Line the full resolution tiles up with the proxy
+  const qreal proxyScale = static_cast<qreal>(proxy.width()) / imageSize.width();
+  m_tiledItem.setScale(proxyScale);
+  m_tiledItem.setSource(imagePath, imageSize, proxyScale);
+}
+
+void ImageViewer::playAnimation(const QString &imagePath) {
+  m_animation.play(imagePath, m_item.pixmap().size());
+}
+
 QPixmap ImageViewer::pixmap() const { return m_item.pixmap(); }
 
-void ImageViewer::scale(qreal s) { QGraphicsView::scale(s, s); }
+void ImageViewer::scale(qreal s) {
+  QGraphicsView::scale(s, s);
+
+  // Tiles already provide the detail for tiled images. On high DPI
+  // screens an image pixel covers several device pixels before 1:1
+  if (transform().m11() * devicePixelRatioF() > 1.0 &&
+      !m_tiledItem.hasSource()) {
+    emit zoomedPastNativeResolution();
+  }
+}
 
 void ImageViewer::resize(int desiredWidth, int desiredHeight) {
   const auto &pixmap = m_item.pixmap();
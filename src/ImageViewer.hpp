@@ -10,6 +10,10 @@
 #include <QAction>
 #include <QClipboard>
 
+#include "AnimationPlayer.hpp"
+#include "ScaledPixmapItem.hpp"
+#include "TiledImageItem.hpp"
+
 #include <iostream>
 #include <optional>
 
@@ -17,7 +21,9 @@ class ImageViewer : public QGraphicsView {
   Q_OBJECT
   
   QGraphicsScene m_scene;
-  QGraphicsPixmapItem m_item;
+  ScaledPixmapItem m_item;
+  TiledImageItem m_tiledItem;
+  AnimationPlayer m_animation;
 
   static constexpr inline qreal ZOOM_IN_SCALE = 1.04;
   static constexpr inline qreal ZOOM_OUT_SCALE = 0.96;
@@ -25,12 +31,21 @@ class ImageViewer : public QGraphicsView {
 public:
   ImageViewer(QWidget *parent = nullptr);
   void setPixmap(const QPixmap &pixmap, int desiredWidth, int desiredHeight);
+  void replacePixmap(const QPixmap &pixmap);
+  void setTiledSource(const QString &imagePath, const QSize &imageSize);
+  /// Plays the image on screen from its first frame, at its current size
+  void playAnimation(const QString &imagePath);
   QPixmap pixmap() const;
   void scale(qreal s);
   void resize(int desiredWidth, int desiredHeight);
   void zoomIn();
   void zoomOut();
 
+signals:
+  /// Emitted when zooming magnifies the pixmap beyond 1:1,
+  /// i.e. a higher resolution decode would show more detail
+  void zoomedPastNativeResolution();
+
 protected:
   bool event(QEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
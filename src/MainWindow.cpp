@@ -37,19 +37,39 @@ MainWindow::MainWindow() : QMainWindow() {
   CONNECT_TO_IMAGE_LOADER(changeSortOrder);
   CONNECT_TO_IMAGE_LOADER(changeSortBy);
   CONNECT_TO_IMAGE_LOADER(copyCurrentImageFullResToClipboard);
-  CONNECT_TO_IMAGE_LOADER(slideShowNext);
+  CONNECT_TO_IMAGE_LOADER(slideShowStart);
+  CONNECT_TO_IMAGE_LOADER(slideShowStop);
+  CONNECT_TO_IMAGE_LOADER(slideShowSetPeriod);
+  CONNECT_TO_IMAGE_LOADER(slideShowSetLoop);
   CONNECT_TO_IMAGE_LOADER(reloadCurrentImage);
+  CONNECT_TO_IMAGE_LOADER(updateDecodeOptions);
+  CONNECT_TO_IMAGE_LOADER(requestFullResolution);
+  CONNECT_TO_IMAGE_LOADER(setViewportSize);
   CONNECT_TO_IMAGE_LOADER(goToFirstImage);
   CONNECT_TO_IMAGE_LOADER(goToLastImage);
+  CONNECT_TO_IMAGE_LOADER(goToImage);
+
+  connect(m_preferences, &Preferences::settingChangedCacheSize, imageLoader,
+          &ImageLoader::updateCacheBudget, Qt::QueuedConnection);
+  connect(m_preferences, &Preferences::settingChangedPrefetch, imageLoader,
+          &ImageLoader::updatePrefetchWindow, Qt::QueuedConnection);
+  connect(m_preferences, &Preferences::settingChangedScreenResolutionDecode,
+          this, [this]() { emit reloadCurrentImage(); });
 
   connect(imageLoader, &ImageLoader::noMoreImagesLeft, this,
           &MainWindow::onNoMoreImagesLeft, Qt::QueuedConnection);
   connect(imageLoader, &ImageLoader::imageLoaded, this,
           &MainWindow::onImageLoaded, Qt::QueuedConnection);
+  connect(imageLoader, &ImageLoader::fullResolutionImageCopied, this,
+          &MainWindow::onFullResolutionImageCopied, Qt::QueuedConnection);
+  connect(imageLoader, &ImageLoader::slideShowEnded, this,
+          &MainWindow::onSlideShowEnded, Qt::QueuedConnection);
 
   // Start the thread
   imageLoaderThread->start();
 
+  m_fileCopier = new FileCopier(this);
+
   // Create a menu bar
   QMenuBar *menuBar = new QMenuBar(this);
   setMenuBar(menuBar);
@@ -117,29 +137,43 @@ MainWindow::MainWindow() : QMainWindow() {
   // Previous Image
   QAction *previousImageAction = new QAction("Previous Image", this);
   connect(previousImageAction, &QAction::triggered, this,
-          [this]() { emit previousImage(imageViewer->pixmap()); });
+          [this]() { emit previousImage(); });
 
   // Next Image
   QAction *nextImageAction = new QAction("Next Image", this);
   connect(nextImageAction, &QAction::triggered, this,
-          [this]() { emit nextImage(imageViewer->pixmap()); });
+          [this]() { emit nextImage(); });
 
   // Last Image
   QAction *lastImageAction = new QAction("Last Image", this);
   connect(lastImageAction, &QAction::triggered, this,
           [this]() { emit goToLastImage(); });
 
-  slideshowTimer = new QTimer(this);
-
+  // Filmstrip under the image
+  QAction *filmstripAction = new QAction("Filmstrip", this);
+  filmstripAction->setShortcut(QKeySequence("Ctrl+T"));
+  filmstripAction->setCheckable(true);
+  connect(filmstripAction, &QAction::toggled, this,
+          &MainWindow::setFilmstripVisible);
+
+  // Thumbnail grid in place of the image
+  m_thumbnailGridAction = new QAction("Thumbnail Grid", this);
+  m_thumbnailGridAction->setShortcut(QKeySequence("Ctrl+G"));
+  m_thumbnailGridAction->setCheckable(true);
+  connect(m_thumbnailGridAction, &QAction::toggled, this,
+          &MainWindow::setThumbnailGridVisible);
+
+  // Timing spans from the whole application, saved when unchecked
+  QAction *recordTraceAction = new QAction("Record Trace", this);
+  recordTraceAction->setCheckable(true);
+  recordTraceAction->setChecked(Trace::isEnabled());
+  connect(recordTraceAction, &QAction::toggled, this,
+          &MainWindow::setTraceRecording);
+
+  // The loader times the slideshow, see SlideshowScheduler
   auto interval =
       m_preferences->get(Preferences::SETTING_SLIDESHOW_PERIOD, 2500).toInt();
   m_preferences->set(Preferences::SETTING_SLIDESHOW_PERIOD, interval);
-  slideshowTimer->setInterval(interval);
-  connect(slideshowTimer, &QTimer::timeout, this,
-          &MainWindow::slideshowTimerCallback);
-
-  m_slideshowLoop =
-      m_preferences->get(Preferences::SETTING_SLIDESHOW_LOOP, false).toBool();
 
   // Add the "Open" action to the "File" menu
   fileMenu->addAction(openAction);
@@ -156,6 +190,11 @@ MainWindow::MainWindow() : QMainWindow() {
   viewMenu->addAction(zoomOutAction);
   viewMenu->addSeparator();
   viewMenu->addAction(slideshowAction);
+  viewMenu->addSeparator();
+  viewMenu->addAction(filmstripAction);
+  viewMenu->addAction(m_thumbnailGridAction);
+  viewMenu->addSeparator();
+  viewMenu->addAction(recordTraceAction);
   goMenu->addAction(firstImageAction);
   goMenu->addAction(previousImageAction);
   goMenu->addAction(nextImageAction);
@@ -166,10 +205,51 @@ MainWindow::MainWindow() : QMainWindow() {
 
   // Create a imageViewer to display the image
   imageViewer = new ImageViewer(this);
+  connect(imageViewer, &ImageViewer::zoomedPastNativeResolution, this,
+          [this]() { emit requestFullResolution(); });
+
+  // Thumbnails of the open folder, either as a strip
+  // under the image or as a grid in place of it
+  m_thumbnailModel = new ThumbnailModel(THUMBNAIL_SIZE, this);
+  connect(imageLoader, &ImageLoader::imageFilesChanged, this,
+          &MainWindow::onImageFilesChanged, Qt::QueuedConnection);
+  connect(imageLoader, &ImageLoader::imageFilesSorted, m_thumbnailModel,
+          &ThumbnailModel::sortImageFiles, Qt::QueuedConnection);
+  connect(imageLoader, &ImageLoader::imageFilesInserted, m_thumbnailModel,
+          &ThumbnailModel::insertImageFiles, Qt::QueuedConnection);
+  connect(imageLoader, &ImageLoader::imageFilesRemoved, m_thumbnailModel,
+          &ThumbnailModel::removeImageFiles, Qt::QueuedConnection);
+
+  // List mode with uniform item sizes lays rows out arithmetically
+  // and only paints the visible cells, so huge folders stay cheap
+  m_thumbnailView = new QListView(this);
+  m_thumbnailView->setModel(m_thumbnailModel);
+  m_thumbnailView->setViewMode(QListView::ListMode);
+  m_thumbnailView->setFlow(QListView::LeftToRight);
+  m_thumbnailView->setUniformItemSizes(true);
+  m_thumbnailView->setResizeMode(QListView::Adjust);
+  m_thumbnailView->setIconSize(QSize(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
+  m_thumbnailView->setGridSize(QSize(THUMBNAIL_SIZE + THUMBNAIL_SPACING,
+                                     THUMBNAIL_SIZE + THUMBNAIL_SPACING));
+  m_thumbnailView->setSelectionMode(QAbstractItemView::SingleSelection);
+  m_thumbnailView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  m_thumbnailView->hide();
+  connect(m_thumbnailView, &QListView::clicked, this,
+          &MainWindow::onThumbnailActivated);
+  connect(m_thumbnailView, &QListView::activated, this,
+          &MainWindow::onThumbnailActivated);
+
+  // Whatever scrolled out of view is not worth decoding
+  connect(m_thumbnailView->horizontalScrollBar(), &QScrollBar::valueChanged,
+          m_thumbnailModel, &ThumbnailModel::cancelOffscreenRequests);
+  connect(m_thumbnailView->verticalScrollBar(), &QScrollBar::valueChanged,
+          m_thumbnailModel, &ThumbnailModel::cancelOffscreenRequests);
+  setThumbnailGridVisible(false);
 
   m_centralWidget = new QWidget(this);
   auto vstackLayout = new QVBoxLayout();
   vstackLayout->addWidget(imageViewer);
+  vstackLayout->addWidget(m_thumbnailView);
   m_centralWidget->setLayout(vstackLayout);
 
   auto savedColor = Preferences::get(Preferences::SETTING_BACKGROUND_COLOR,
@@ -183,6 +263,10 @@ MainWindow::MainWindow() : QMainWindow() {
 
   setCentralWidget(m_centralWidget);
 
+  // The viewer is not laid out yet, the window
+  // size is close enough for the first image
+  emit setViewportSize(size() * devicePixelRatio());
+
   openImage();
 }
 
@@ -228,14 +312,20 @@ void MainWindow::createSortByMenu(QMenu *viewMenu) {
   QAction *nameAction = new QAction(tr("Name"), this);
   QAction *sizeAction = new QAction(tr("Size"), this);
   QAction *dateModifiedAction = new QAction(tr("Date Modified"), this);
+  QAction *captureTimeAction = new QAction(tr("Capture Time"), this);
+  QAction *cameraAction = new QAction(tr("Camera"), this);
 
   // Set checkable property and add actions to the group
   nameAction->setCheckable(true);
   sizeAction->setCheckable(true);
   dateModifiedAction->setCheckable(true);
+  captureTimeAction->setCheckable(true);
+  cameraAction->setCheckable(true);
   sortGroup->addAction(nameAction);
   sortGroup->addAction(sizeAction);
   sortGroup->addAction(dateModifiedAction);
+  sortGroup->addAction(captureTimeAction);
+  sortGroup->addAction(cameraAction);
 
   // Connect actions to slots
   connect(nameAction, &QAction::triggered, this,
@@ -244,6 +334,10 @@ void MainWindow::createSortByMenu(QMenu *viewMenu) {
           [this]() { emit changeSortBy(SortBy::size); });
   connect(dateModifiedAction, &QAction::triggered, this,
           [this]() { emit changeSortBy(SortBy::date_modified); });
+  connect(captureTimeAction, &QAction::triggered, this,
+          [this]() { emit changeSortBy(SortBy::capture_time); });
+  connect(cameraAction, &QAction::triggered, this,
+          [this]() { emit changeSortBy(SortBy::camera); });
 
   // By default, set "Ascending" as checked
   nameAction->setChecked(true);
@@ -252,12 +346,14 @@ void MainWindow::createSortByMenu(QMenu *viewMenu) {
   sortByMenu->addAction(nameAction);
   sortByMenu->addAction(sizeAction);
   sortByMenu->addAction(dateModifiedAction);
+  sortByMenu->addAction(captureTimeAction);
+  sortByMenu->addAction(cameraAction);
 }
 
 void MainWindow::openImage() {
   // Open a file dialog to select an image
   QString fileFilter = "Images (*.png *.jpg *.jpeg *.heic *.nef "
-                       "*.tiff *.webp)";
+                       "*.tiff *.webp *.gif)";
 
   QString previousOpenPath =
       m_preferences->get(Preferences::SETTING_PREVIOUS_OPEN_PATH, "")
@@ -284,6 +380,13 @@ void MainWindow::copyToClipboard() {
   emit copyCurrentImageFullResToClipboard();
 }
 
+void MainWindow::onFullResolutionImageCopied(const QPixmap &imagePixmap) {
+  /// The clipboard belongs to the GUI thread. The data is
+  /// only encoded once another application pastes it
+  QClipboard *clipboard = QGuiApplication::clipboard();
+  clipboard->setMimeData(new ImageMimeData(imagePixmap));
+}
+
 void MainWindow::copyImagePathToClipboard() {
   QClipboard *clipboard = QGuiApplication::clipboard();
   clipboard->setText(m_currentFileInfo.absoluteFilePath());
@@ -300,12 +403,6 @@ void setLastDestination(const QString &path) {
 }
 
 void MainWindow::copyToLocation() {
-  QFile sourceFile(m_currentFileInfo.absoluteFilePath());
-  if (!sourceFile.open(QIODevice::ReadOnly)) {
-    qWarning() << "Failed to open source file:" << sourceFile.errorString();
-    return;
-  }
-
   QString lastUsedDestination = getLastDestination();
   QDir candidateDir(lastUsedDestination);
   QFileInfo candidateFileInfo(candidateDir, m_currentFileInfo.fileName());
@@ -313,40 +410,90 @@ void MainWindow::copyToLocation() {
 
   QString destinationFilePath = QFileDialog::getSaveFileName(
       this, tr("Save Image"), candidateSaveLocation,
-      tr("Images (*.png *.jpg *.jpeg *.heic *.nef *.tiff *.webp);;All Files "
-         "(*)"));
-  if (!destinationFilePath.isEmpty()) {
-
-    // Open the destination file for writing
-    QFile destinationFile(destinationFilePath);
-    if (!destinationFile.open(QIODevice::WriteOnly)) {
-      qWarning() << "Failed to open destination file:"
-                 << destinationFile.errorString();
-      sourceFile.close(); // Close the source file before returning
-      return;
-    }
-
-    // Copy the contents of the source file to the destination file
-    QByteArray data = sourceFile.readAll();
-    destinationFile.write(data);
-
-    // Close both files
-    sourceFile.close();
-    destinationFile.close();
-
-    setLastDestination(destinationFilePath);
+      tr("Images (*.png *.jpg *.jpeg *.heic *.nef *.tiff *.webp *.gif);;"
+         "All Files (*)"));
+  if (destinationFilePath.isEmpty()) {
+    return;
   }
+
+  // Copies in the background, the dialog only shows
+  // up if the copy takes longer than a moment
+  auto *progressDialog = new QProgressDialog(
+      "Copying " + m_currentFileInfo.fileName() + "...", "Cancel", 0, 100,
+      this);
+  progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+  progressDialog->setMinimumDuration(500);
+  progressDialog->setValue(0);
+
+  auto cancelled = m_fileCopier->copy(m_currentFileInfo.absoluteFilePath(),
+                                      destinationFilePath);
+  connect(progressDialog, &QProgressDialog::canceled, this,
+          [cancelled]() { *cancelled = true; });
+  connect(m_fileCopier, &FileCopier::progress, progressDialog,
+          [progressDialog, destinationFilePath](const QString &destination,
+                                                qint64 copiedBytes,
+                                                qint64 totalBytes) {
+            if (destination == destinationFilePath && totalBytes > 0) {
+              progressDialog->setValue(
+                  static_cast<int>(copiedBytes * 100 / totalBytes));
+            }
+          });
+  connect(m_fileCopier, &FileCopier::finished, progressDialog,
+          [this, progressDialog, destinationFilePath, cancelled](
+              const QString &destination, bool success,
+              const QString &errorString) {
+            if (destination != destinationFilePath) {
+              return;
+            }
+            progressDialog->close();
+            if (success) {
+              setLastDestination(destinationFilePath);
+            } else if (!*cancelled) {
+              QMessageBox::warning(this, "Copy failed",
+                                   "Could not copy to " + destination +
+                                       "\n" + errorString);
+            }
+          });
 }
 
 void MainWindow::onImageLoaded(const QFileInfo &fileInfo,
                                const QPixmap &imagePixmap,
                                const ImageInfo &imageInfo) {
+  Trace::asyncEnd("ui", "show image", qHash(fileInfo.filePath()));
+  Trace::Span span("ui", "show image");
+
+  const bool sameImage =
+      fileInfo.absoluteFilePath() == m_currentFileInfo.absoluteFilePath();
+  if (sameImage && !imageViewer->pixmap().isNull()) {
+    // A better decode of the image already on screen,
+    // e.g. the full RAW after its embedded preview
+    imageViewer->replacePixmap(imagePixmap);
+  } else {
+    // Set the resized image to the QLabel
+    imageViewer->setPixmap(imagePixmap, width() * getScaleFactor(),
+                           height() * getScaleFactor());
+  }
+
+  if (imageInfo.tileable) {
+    // Zooming in draws full resolution tiles over the proxy
+    imageViewer->setTiledSource(fileInfo.absoluteFilePath(),
+                                QSize(imageInfo.width, imageInfo.height));
+  }
+
+  if (imageInfo.animated) {
+    imageViewer->playAnimation(fileInfo.absoluteFilePath());
+  }
 
   m_currentFileInfo = fileInfo;
 
-  // Set the resized image to the QLabel
-  imageViewer->setPixmap(imagePixmap, width() * getScaleFactor(),
-                         height() * getScaleFactor());
+  // Better decodes of the same image leave the
+  // thumbnails where the user scrolled them
+  auto thumbnailIndex = m_thumbnailModel->indexOf(fileInfo.absoluteFilePath());
+  if (!sameImage && thumbnailIndex.isValid()) {
+    m_thumbnailView->setCurrentIndex(thumbnailIndex);
+    m_thumbnailView->scrollTo(thumbnailIndex,
+                              QAbstractItemView::PositionAtCenter);
+  }
 
   setWindowTitle(fileInfo.fileName() +
                  QString(" (%1 x %2) [%3]")
@@ -355,6 +502,20 @@ void MainWindow::onImageLoaded(const QFileInfo &fileInfo,
                      .arg(prettyPrintSize(fileInfo.size())));
 }
 
+void MainWindow::onImageFilesChanged(
+    const ImageFileIndex::Snapshot &imageFiles) {
+  m_thumbnailModel->setImageFiles(imageFiles);
+
+  // A new folder, resetting the model dropped the selection
+  auto thumbnailIndex =
+      m_thumbnailModel->indexOf(m_currentFileInfo.absoluteFilePath());
+  if (thumbnailIndex.isValid()) {
+    m_thumbnailView->setCurrentIndex(thumbnailIndex);
+    m_thumbnailView->scrollTo(thumbnailIndex,
+                              QAbstractItemView::PositionAtCenter);
+  }
+}
+
 void MainWindow::onNoMoreImagesLeft() {
   auto emptyImage = QImage(0, 0, QImage::Format_ARGB32);
   auto emptyPixmap = QPixmap::fromImage(emptyImage);
@@ -394,6 +555,9 @@ void MainWindow::resizeEvent(QResizeEvent *event) {
   auto desiredHeight = height() * getScaleFactor();
   imageViewer->resize(desiredWidth, desiredHeight);
 
+  // Images larger than this are decoded at this size
+  emit setViewportSize(imageViewer->size() * devicePixelRatio());
+
   QMainWindow::resizeEvent(event);
 }
 
@@ -416,23 +580,22 @@ void MainWindow::zoomIn() { imageViewer->zoomIn(); }
 
 void MainWindow::zoomOut() { imageViewer->zoomOut(); }
 
-void MainWindow::slideshowTimerCallback() {
-  emit slideShowNext(imageViewer->pixmap(), m_slideshowLoop);
+void MainWindow::startSlideshow() {
+  m_slideshowRunning = true;
+  emit slideShowStart(
+      m_preferences->get(Preferences::SETTING_SLIDESHOW_PERIOD, 2500).toInt(),
+      m_preferences->get(Preferences::SETTING_SLIDESHOW_LOOP, false).toBool());
 }
 
-void MainWindow::startSlideshow() { slideshowTimer->start(); }
+void MainWindow::onSlideShowEnded() { m_slideshowRunning = false; }
 
 qreal MainWindow::getScaleFactor() const { return 1; }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
 
-  if (slideshowTimer->isActive()) {
-    slideshowTimer->stop();
-    /// TODO: Add reachedEnd signal to stop slideshow
-    /// when no more images left
-    ///
-    /// this can also be used to restart the slidehow from
-    /// the start
+  if (m_slideshowRunning) {
+    m_slideshowRunning = false;
+    emit slideShowStop();
   }
 
   switch (event->key()) {
@@ -443,15 +606,89 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
     /// std::cout << "DOWN\n";
     break;
   case Qt::Key_Right:
-    emit nextImage(imageViewer->pixmap());
+    emit nextImage();
     break;
   case Qt::Key_Left:
-    emit previousImage(imageViewer->pixmap());
+    emit previousImage();
+    break;
+  case Qt::Key_Escape:
+    if (m_thumbnailGridVisible) {
+      m_thumbnailGridAction->setChecked(false);
+    }
     break;
   }
   /// QMainWindow::keyPressEvent(event);
 }
 
+void MainWindow::setTraceRecording(bool enabled) {
+  if (enabled) {
+    Trace::setEnabled(true);
+    return;
+  }
+
+  // Stop first, so saving does not record into the trace it writes
+  Trace::setEnabled(false);
+  const QString path = QFileDialog::getSaveFileName(
+      this, "Save Trace", "imageviewer-trace.json", "Trace (*.json)");
+  if (path.isEmpty()) {
+    return;
+  }
+  QString error;
+  if (!Trace::writeChromeTrace(path, &error)) {
+    QMessageBox::warning(this, "Error",
+                         "Could not write " + path + ": " + error);
+  }
+}
+
+void MainWindow::setFilmstripVisible(bool visible) {
+  m_filmstripVisible = visible;
+  if (!m_thumbnailGridVisible) {
+    m_thumbnailView->setVisible(visible);
+  }
+}
+
+void MainWindow::setThumbnailGridVisible(bool visible) {
+  m_thumbnailGridVisible = visible;
+  imageViewer->setVisible(!visible);
+
+  // The grid wraps and takes the keyboard, the strip is a
+  // single row that leaves the arrow keys to the viewer
+  m_thumbnailView->setWrapping(visible);
+  if (visible) {
+    m_thumbnailView->setMinimumHeight(0);
+    m_thumbnailView->setMaximumHeight(QWIDGETSIZE_MAX);
+    m_thumbnailView->setFocusPolicy(Qt::StrongFocus);
+    m_thumbnailView->show();
+    m_thumbnailView->setFocus();
+  } else {
+    m_thumbnailView->setFixedHeight(
+        THUMBNAIL_SIZE + THUMBNAIL_SPACING +
+        m_thumbnailView->horizontalScrollBar()->sizeHint().height());
+    m_thumbnailView->setFocusPolicy(Qt::NoFocus);
+    m_thumbnailView->setVisible(m_filmstripVisible);
+    setFocus();
+  }
+
+  if (m_thumbnailView->currentIndex().isValid()) {
+    m_thumbnailView->scrollTo(m_thumbnailView->currentIndex(),
+                              QAbstractItemView::PositionAtCenter);
+  }
+}
+
+void MainWindow::onThumbnailActivated(const QModelIndex &index) {
+  auto imagePath = m_thumbnailModel->path(index);
+  if (imagePath.isEmpty()) {
+    return;
+  }
+
+  emit goToImage(imagePath);
+
+  // Picking from the grid goes back to the image
+  if (m_thumbnailGridVisible) {
+    m_thumbnailGridAction->setChecked(false);
+  }
+}
+
 void MainWindow::showPreferences() { m_preferences->show(); }
 
 void MainWindow::settingChangedBackgroundColor(const QColor &color) {
@@ -461,13 +698,13 @@ void MainWindow::settingChangedBackgroundColor(const QColor &color) {
 }
 
 void MainWindow::settingChangedSlideShowPeriod() {
-  slideshowTimer->setInterval(
+  emit slideShowSetPeriod(
       m_preferences->get(Preferences::SETTING_SLIDESHOW_PERIOD, 2500).toInt());
 }
 
 void MainWindow::settingChangedSlideShowLoop() {
-  m_slideshowLoop =
-      m_preferences->get(Preferences::SETTING_SLIDESHOW_LOOP, false).toBool();
+  emit slideShowSetLoop(
+      m_preferences->get(Preferences::SETTING_SLIDESHOW_LOOP, false).toBool());
 }
 
-void MainWindow::onRawSettingChanged() { emit reloadCurrentImage(); }
\ No newline at end of file
+void MainWindow::onRawSettingChanged() { emit updateDecodeOptions(); }
\ No newline at end of file
@@ -1,12 +1,16 @@
 #pragma once
 #include <QApplication>
+#include <QClipboard>
 #include <QCloseEvent>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QListView>
 #include <QPixmap>
+#include <QProgressDialog>
 #include <QPushButton>
 #include <QScreen>
+#include <QScrollBar>
 #include <QSplitter>
 #include <QThread>
 #include <QVBoxLayout>
@@ -17,11 +21,14 @@
 #include <QMenuBar>
 #include <QSettings>
 
+#include "FileCopier.hpp"
 #include "ImageLoader.hpp"
 #include "ImageViewer.hpp"
 #include "IconHelper.hpp"
+#include "ImageMimeData.hpp"
 #include "Preferences.hpp"
 #include "SortOptions.hpp"
+#include "ThumbnailModel.hpp"
 
 #include <chrono>
 #include <iostream>
@@ -31,6 +38,8 @@ class MainWindow : public QMainWindow {
   Q_OBJECT
 
   static constexpr qreal SCALE_FACTOR = 0.90;
+  static constexpr int THUMBNAIL_SIZE = 128;
+  static constexpr int THUMBNAIL_SPACING = 8;
 
 public:
   MainWindow();
@@ -43,6 +52,8 @@ public slots:
   void copyToLocation();
   void onImageLoaded(const QFileInfo& imageFileInfo, const QPixmap &imagePixmap, const ImageInfo& imageInfo);
   void onNoMoreImagesLeft();
+  void onImageFilesChanged(const ImageFileIndex::Snapshot &imageFiles);
+  void onFullResolutionImageCopied(const QPixmap &imagePixmap);
   void showPreferences();
 
   // Slots for each setting change in the preferences widget
@@ -63,26 +74,37 @@ signals:
   void loadImage(const QString &imagePath);
   void goToStart();
   void goBackward();
-  void previousImage(const QPixmap &currentPixmap);
-  void nextImage(const QPixmap &currentPixmap);
+  void previousImage();
+  void nextImage();
   void goForward();
   void deleteCurrentImage(const QFileInfo& fileInfo);
   void changeSortOrder(SortOrder order);
   void changeSortBy(SortBy type);
   void copyCurrentImageFullResToClipboard();
-  void slideShowNext(const QPixmap& currentPixmap, bool loop);
+  void slideShowStart(int periodMs, bool loop);
+  void slideShowStop();
+  void slideShowSetPeriod(int periodMs);
+  void slideShowSetLoop(bool loop);
   void reloadCurrentImage();
+  void updateDecodeOptions();
+  void requestFullResolution();
+  void setViewportSize(const QSize &size);
   void goToFirstImage();
   void goToLastImage();
+  void goToImage(const QString &imagePath);
 
 private:
   void createSortOrderMenu(QMenu * viewMenu);
   void createSortByMenu(QMenu * viewMenu);
   void zoomIn();
   void zoomOut();
-  void slideshowTimerCallback();
   void startSlideshow();
+  void onSlideShowEnded();
   void confirmAndDeleteCurrentImage();
+  void setFilmstripVisible(bool visible);
+  void setThumbnailGridVisible(bool visible);
+  void setTraceRecording(bool enabled);
+  void onThumbnailActivated(const QModelIndex &index);
   qreal getScaleFactor() const;
 
 private:
@@ -91,6 +113,8 @@ private:
   ImageLoader *imageLoader;
   QThread *imageLoaderThread;
 
+  FileCopier *m_fileCopier;
+
   bool m_sidebarVisible{false};
   ImageViewer *imageViewer;
   QFileInfo m_currentFileInfo;
@@ -103,11 +127,16 @@ private:
   QIcon m_rightArrowIcon;
   QPushButton *m_rightArrowButton;
 
+  ThumbnailModel *m_thumbnailModel;
+  QListView *m_thumbnailView;
+  QAction *m_thumbnailGridAction;
+  bool m_filmstripVisible{false};
+  bool m_thumbnailGridVisible{false};
+
   QWidget * m_centralWidget;
   std::atomic<bool> m_fullScreen{false};
 
-  QTimer *slideshowTimer;
-  std::atomic<bool> m_slideshowLoop;
+  bool m_slideshowRunning{false};
 
   Preferences *m_preferences;
 };
\ No newline at end of file
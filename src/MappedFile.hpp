@@ -0,0 +1,59 @@
+#pragma once
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include "Trace.hpp"
+
+/// Read-only memory mapping of a whole file.
+///
+/// Decoders read straight from the page cache through it instead of
+/// copying the file into buffers first, and only the pages a decoder
+/// touches are ever read. isValid() is false when the file cannot be
+/// opened or mapped, e.g. on some network filesystems, and callers then
+/// read the file normally.
+class MappedFile {
+  QFile m_file;
+  uchar *m_data{nullptr};
+  qint64 m_size{0};
+  QByteArray m_bytes;
+  QBuffer m_buffer;
+
+public:
+  explicit MappedFile(const QString &path) : m_file(path) {
+    Trace::Span span("io", "map file");
+    if (!m_file.open(QIODevice::ReadOnly)) {
+      return;
+    }
+    m_size = m_file.size();
+    if (m_size > 0) {
+      m_data = m_file.map(0, m_size);
+    }
+    if (m_data) {
+      // Wraps the mapping, nothing is copied
+      m_bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(m_data),
+                                        m_size);
+      m_buffer.setBuffer(&m_bytes);
+      m_buffer.open(QIODevice::ReadOnly);
+    }
+  }
+
+  ~MappedFile() {
+    m_buffer.close();
+    if (m_data) {
+      m_file.unmap(m_data);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool isValid() const { return m_data != nullptr; }
+  const uchar *data() const { return m_data; }
+  qint64 size() const { return m_size; }
+
+  /// Sequential view of the mapping for QImageReader and friends,
+  /// valid as long as this object
+  QIODevice *device() { return &m_buffer; }
+};
\ No newline at end of file
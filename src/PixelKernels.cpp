@@ -0,0 +1,588 @@
+#include "PixelKernels.hpp"
+#include <QDebug>
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#elif defined(__aarch64__) && defined(__ARM_NEON) &&                          \
+    Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#define PIXEL_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/// Source pixels covered by one destination pixel along one axis.
+/// Weights of a span add up to 1
+struct Span {
+  int first;
+  int count;
+  int weights; // offset into the weight table
+};
+
+struct SpanTable {
+  std::vector<Span> spans;
+  std::vector<float> weights;
+};
+
+SpanTable makeSpans(int sourceSize, int destinationSize) {
+  SpanTable table;
+  table.spans.reserve(destinationSize);
+
+  const double scale = double(sourceSize) / destinationSize;
+  for (int i = 0; i < destinationSize; ++i) {
+    const double begin = i * scale;
+    const double end = std::min((i + 1) * scale, double(sourceSize));
+    const int first = int(begin);
+    const int last = std::min(int(std::ceil(end)), sourceSize);
+
+    table.spans.push_back({first, last - first, int(table.weights.size())});
+    for (int j = first; j < last; ++j) {
+      const double coverage =
+          std::min(j + 1.0, end) - std::max(double(j), begin);
+      table.weights.push_back(float(coverage / scale));
+    }
+  }
+  return table;
+}
+
+/// One set of kernels, all from the same instruction set
+struct Kernels {
+  const char *name;
+  void (*rgb888ToRgb32)(const uchar *, quint32 *, int);
+  void (*rgb48ToRgbx64)(const quint16 *, quint16 *, int);
+
+  /// Averages a row horizontally into four floats per destination pixel
+  void (*reduceRow)(const quint32 *, const Span *, const float *, int,
+                    float *);
+  /// accumulator += weight * row, `count` floats
+  void (*accumulate)(float *, const float *, float, int);
+  /// Rounds four floats per pixel back to bytes
+  void (*store)(const float *, quint32 *, int);
+};
+
+// Scalar
+
+void rgb888ToRgb32Scalar(const uchar *source, quint32 *destination,
+                         int count) {
+  for (int i = 0; i < count; ++i) {
+    destination[i] = 0xff000000u | (quint32(source[0]) << 16) |
+                     (quint32(source[1]) << 8) | source[2];
+    source += 3;
+  }
+}
+
+void rgb48ToRgbx64Scalar(const quint16 *source, quint16 *destination,
+                         int count) {
+  for (int i = 0; i < count; ++i) {
+    destination[0] = source[0];
+    destination[1] = source[1];
+    destination[2] = source[2];
+    destination[3] = 0xffff;
+    source += 3;
+    destination += 4;
+  }
+}
+
+void reduceRowScalar(const quint32 *row, const Span *spans,
+                     const float *weights, int count, float *out) {
+  for (int x = 0; x < count; ++x) {
+    const Span &span = spans[x];
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    for (int k = 0; k < span.count; ++k) {
+      const auto *pixel = reinterpret_cast<const uchar *>(row + span.first + k);
+      const float weight = weights[span.weights + k];
+      for (int c = 0; c < 4; ++c) {
+        sum[c] = sum[c] + float(pixel[c]) * weight;
+      }
+    }
+    std::memcpy(out + x * 4, sum, sizeof(sum));
+  }
+}
+
+void accumulateScalar(float *accumulator, const float *row, float weight,
+                      int count) {
+  for (int i = 0; i < count; ++i) {
+    accumulator[i] = accumulator[i] + row[i] * weight;
+  }
+}
+
+void storeScalar(const float *accumulator, quint32 *out, int count) {
+  for (int x = 0; x < count; ++x) {
+    auto *pixel = reinterpret_cast<uchar *>(out + x);
+    for (int c = 0; c < 4; ++c) {
+      pixel[c] = uchar(std::min(int(accumulator[x * 4 + c] + 0.5f), 255));
+    }
+  }
+}
+
+constexpr Kernels SCALAR_KERNELS = {"scalar",        rgb888ToRgb32Scalar,
+                                    rgb48ToRgbx64Scalar, reduceRowScalar,
+                                    accumulateScalar, storeScalar};
+
+#ifdef PIXEL_KERNELS_X86
+
+// SSE4.1, which includes the SSSE3 byte shuffle
+
+TARGET("sse4.1")
+void rgb888ToRgb32Sse(const uchar *source, quint32 *destination, int count) {
+  const __m128i shuffle =
+      _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m128i alpha = _mm_set1_epi32(int(0xff000000u));
+
+  /// Each load reads 16 bytes for 4 pixels, stop
+  /// before that runs past the end of the row
+  int i = 0;
+  for (; i + 6 <= count; i += 4) {
+    __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 3));
+    pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), pixels);
+  }
+  rgb888ToRgb32Scalar(source + i * 3, destination + i, count - i);
+}
+
+TARGET("sse4.1")
+void rgb48ToRgbx64Sse(const quint16 *source, quint16 *destination,
+                      int count) {
+  const __m128i shuffle =
+      _mm_setr_epi8(0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  const __m128i alpha = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+
+  int i = 0;
+  for (; i + 3 <= count; i += 2) {
+    __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 3));
+    pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i * 4),
+                     pixels);
+  }
+  rgb48ToRgbx64Scalar(source + i * 3, destination + i * 4, count - i);
+}
+
+/// One pixel is one register, four channels wide
+TARGET("sse4.1")
+void reduceRowSse(const quint32 *row, const Span *spans,
+                  const float *weights, int count, float *out) {
+  for (int x = 0; x < count; ++x) {
+    const Span &span = spans[x];
+    __m128 sum = _mm_setzero_ps();
+    for (int k = 0; k < span.count; ++k) {
+      const __m128 pixel = _mm_cvtepi32_ps(
+          _mm_cvtepu8_epi32(_mm_cvtsi32_si128(int(row[span.first + k]))));
+      const __m128 weight = _mm_set1_ps(weights[span.weights + k]);
+      sum = _mm_add_ps(sum, _mm_mul_ps(pixel, weight));
+    }
+    _mm_storeu_ps(out + x * 4, sum);
+  }
+}
+
+TARGET("sse4.1")
+void accumulateSse(float *accumulator, const float *row, float weight,
+                   int count) {
+  const __m128 weights = _mm_set1_ps(weight);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 sum = _mm_add_ps(
+        _mm_loadu_ps(accumulator + i),
+        _mm_mul_ps(_mm_loadu_ps(row + i), weights));
+    _mm_storeu_ps(accumulator + i, sum);
+  }
+  accumulateScalar(accumulator + i, row + i, weight, count - i);
+}
+
+TARGET("sse4.1")
+void storeSse(const float *accumulator, quint32 *out, int count) {
+  const __m128 half = _mm_set1_ps(0.5f);
+  int x = 0;
+  for (; x + 4 <= count; x += 4) {
+    const float *in = accumulator + x * 4;
+    const __m128i a = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in), half));
+    const __m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in + 4), half));
+    const __m128i c = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in + 8), half));
+    const __m128i d =
+        _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in + 12), half));
+    const __m128i bytes =
+        _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), bytes);
+  }
+  storeScalar(accumulator + x * 4, out + x, count - x);
+}
+
+constexpr Kernels SSE_KERNELS = {"SSE4.1",       rgb888ToRgb32Sse,
+                                 rgb48ToRgbx64Sse, reduceRowSse,
+                                 accumulateSse,  storeSse};
+
+// AVX2, two SSE lanes side by side. The horizontal reduction gains
+// nothing from the wider registers and stays on SSE4.1
+
+TARGET("avx2")
+void rgb888ToRgb32Avx2(const uchar *source, quint32 *destination,
+                       int count) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, //
+      2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m256i alpha = _mm256_set1_epi32(int(0xff000000u));
+
+  /// The upper lane loads 16 bytes from 12 bytes in
+  int i = 0;
+  for (; i + 10 <= count; i += 8) {
+    const uchar *in = source + i * 3;
+    const __m256i pixels = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 12)), 1);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(destination + i),
+        _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+  }
+  rgb888ToRgb32Sse(source + i * 3, destination + i, count - i);
+}
+
+TARGET("avx2")
+void rgb48ToRgbx64Avx2(const quint16 *source, quint16 *destination,
+                       int count) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1, //
+      0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  const __m256i alpha =
+      _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+
+  int i = 0;
+  for (; i + 5 <= count; i += 4) {
+    const quint16 *in = source + i * 3;
+    const __m256i pixels = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 6)), 1);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(destination + i * 4),
+        _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+  }
+  rgb48ToRgbx64Sse(source + i * 3, destination + i * 4, count - i);
+}
+
+TARGET("avx2")
+void accumulateAvx2(float *accumulator, const float *row, float weight,
+                    int count) {
+  const __m256 weights = _mm256_set1_ps(weight);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 sum = _mm256_add_ps(
+        _mm256_loadu_ps(accumulator + i),
+        _mm256_mul_ps(_mm256_loadu_ps(row + i), weights));
+    _mm256_storeu_ps(accumulator + i, sum);
+  }
+  accumulateScalar(accumulator + i, row + i, weight, count - i);
+}
+
+TARGET("avx2")
+void storeAvx2(const float *accumulator, quint32 *out, int count) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  int x = 0;
+  for (; x + 8 <= count; x += 8) {
+    const float *in = accumulator + x * 4;
+    const __m256i a =
+        _mm256_cvttps_epi32(_mm256_add_ps(_mm256_loadu_ps(in), half));
+    const __m256i b =
+        _mm256_cvttps_epi32(_mm256_add_ps(_mm256_loadu_ps(in + 8), half));
+    const __m256i c =
+        _mm256_cvttps_epi32(_mm256_add_ps(_mm256_loadu_ps(in + 16), half));
+    const __m256i d =
+        _mm256_cvttps_epi32(_mm256_add_ps(_mm256_loadu_ps(in + 24), half));
+
+    /// Packing works per lane, so pixels 0 2 4 6 end up in the lower
+    /// lane and 1 3 5 7 in the upper one until the final permute
+    const __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                              _mm256_packs_epi32(c, d));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(out + x),
+        _mm256_permutevar8x32_epi32(bytes,
+                                    _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+  }
+  storeSse(accumulator + x * 4, out + x, count - x);
+}
+
+constexpr Kernels AVX2_KERNELS = {"AVX2",          rgb888ToRgb32Avx2,
+                                  rgb48ToRgbx64Avx2, reduceRowSse,
+                                  accumulateAvx2,  storeAvx2};
+
+#endif
+
+#ifdef PIXEL_KERNELS_NEON
+
+void rgb888ToRgb32Neon(const uchar *source, quint32 *destination,
+                       int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x3_t rgb = vld3q_u8(source + i * 3);
+    uint8x16x4_t bgra;
+    bgra.val[0] = rgb.val[2];
+    bgra.val[1] = rgb.val[1];
+    bgra.val[2] = rgb.val[0];
+    bgra.val[3] = vdupq_n_u8(0xff);
+    vst4q_u8(reinterpret_cast<uint8_t *>(destination + i), bgra);
+  }
+  rgb888ToRgb32Scalar(source + i * 3, destination + i, count - i);
+}
+
+void rgb48ToRgbx64Neon(const quint16 *source, quint16 *destination,
+                       int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8x3_t rgb = vld3q_u16(source + i * 3);
+    uint16x8x4_t rgbx;
+    rgbx.val[0] = rgb.val[0];
+    rgbx.val[1] = rgb.val[1];
+    rgbx.val[2] = rgb.val[2];
+    rgbx.val[3] = vdupq_n_u16(0xffff);
+    vst4q_u16(destination + i * 4, rgbx);
+  }
+  rgb48ToRgbx64Scalar(source + i * 3, destination + i * 4, count - i);
+}
+
+void reduceRowNeon(const quint32 *row, const Span *spans,
+                   const float *weights, int count, float *out) {
+  for (int x = 0; x < count; ++x) {
+    const Span &span = spans[x];
+    float32x4_t sum = vdupq_n_f32(0.f);
+    for (int k = 0; k < span.count; ++k) {
+      const uint8x8_t bytes =
+          vreinterpret_u8_u32(vdup_n_u32(row[span.first + k]));
+      const float32x4_t pixel =
+          vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+      sum = vaddq_f32(sum, vmulq_n_f32(pixel, weights[span.weights + k]));
+    }
+    vst1q_f32(out + x * 4, sum);
+  }
+}
+
+void accumulateNeon(float *accumulator, const float *row, float weight,
+                    int count) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(accumulator + i,
+              vaddq_f32(vld1q_f32(accumulator + i),
+                        vmulq_n_f32(vld1q_f32(row + i), weight)));
+  }
+  accumulateScalar(accumulator + i, row + i, weight, count - i);
+}
+
+void storeNeon(const float *accumulator, quint32 *out, int count) {
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  int x = 0;
+  for (; x + 4 <= count; x += 4) {
+    const float *in = accumulator + x * 4;
+    uint16x8_t low = vcombine_u16(
+        vqmovn_u32(vcvtq_u32_f32(vaddq_f32(vld1q_f32(in), half))),
+        vqmovn_u32(vcvtq_u32_f32(vaddq_f32(vld1q_f32(in + 4), half))));
+    uint16x8_t high = vcombine_u16(
+        vqmovn_u32(vcvtq_u32_f32(vaddq_f32(vld1q_f32(in + 8), half))),
+        vqmovn_u32(vcvtq_u32_f32(vaddq_f32(vld1q_f32(in + 12), half))));
+    vst1q_u8(reinterpret_cast<uint8_t *>(out + x),
+             vcombine_u8(vqmovn_u16(low), vqmovn_u16(high)));
+  }
+  storeScalar(accumulator + x * 4, out + x, count - x);
+}
+
+constexpr Kernels NEON_KERNELS = {"NEON",           rgb888ToRgb32Neon,
+                                  rgb48ToRgbx64Neon, reduceRowNeon,
+                                  accumulateNeon,   storeNeon};
+
+#endif
+
+/// More than 8 bits per channel, which the kernels would round away
+bool isHighBitDepth(QImage::Format format) {
+  switch (format) {
+  case QImage::Format_RGBX64:
+  case QImage::Format_RGBA64:
+  case QImage::Format_RGBA64_Premultiplied:
+  case QImage::Format_Grayscale16:
+  case QImage::Format_BGR30:
+  case QImage::Format_A2BGR30_Premultiplied:
+  case QImage::Format_RGB30:
+  case QImage::Format_A2RGB30_Premultiplied:
+  case QImage::Format_RGBX16FPx4:
+  case QImage::Format_RGBA16FPx4:
+  case QImage::Format_RGBA16FPx4_Premultiplied:
+  case QImage::Format_RGBX32FPx4:
+  case QImage::Format_RGBA32FPx4:
+  case QImage::Format_RGBA32FPx4_Premultiplied:
+    return true;
+  default:
+    return false;
+  }
+}
+
+QImage downscaleWith(const Kernels &kernels, const QImage &image,
+                     const QSize &size) {
+  const QImage source =
+      image.format() == QImage::Format_RGB32
+          ? image
+          : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+  QImage result(size, source.format());
+  if (result.isNull()) {
+    return result;
+  }
+
+  const auto columns = makeSpans(source.width(), size.width());
+  const auto rows = makeSpans(source.height(), size.height());
+
+  const int floatsPerRow = size.width() * 4;
+  std::vector<float> reduced(floatsPerRow);
+  std::vector<float> accumulator(floatsPerRow);
+
+  /// A source row on the border of two destination rows
+  /// counts in both, reduce it only once
+  int reducedRow = -1;
+
+  for (int y = 0; y < size.height(); ++y) {
+    const Span &span = rows.spans[y];
+    std::fill(accumulator.begin(), accumulator.end(), 0.f);
+
+    for (int k = 0; k < span.count; ++k) {
+      const int sourceRow = span.first + k;
+      if (sourceRow != reducedRow) {
+        kernels.reduceRow(
+            reinterpret_cast<const quint32 *>(source.constScanLine(sourceRow)),
+            columns.spans.data(), columns.weights.data(), size.width(),
+            reduced.data());
+        reducedRow = sourceRow;
+      }
+      kernels.accumulate(accumulator.data(), reduced.data(),
+                         rows.weights[span.weights + k], floatsPerRow);
+    }
+
+    kernels.store(accumulator.data(),
+                  reinterpret_cast<quint32 *>(result.scanLine(y)),
+                  size.width());
+  }
+
+  result.setColorSpace(image.colorSpace());
+  return result;
+}
+
+/// Runs both kernel sets over the same pseudo-random pixels. Conversions
+/// must match exactly. Averages may differ by one where the compiler
+/// fuses a multiply and add in one version and not the other
+bool agreesWithScalar(const Kernels &kernels) {
+  /// Odd sizes, so every loop also runs its scalar tail
+  constexpr int WIDTH = 203;
+  constexpr int HEIGHT = 61;
+
+  quint32 state = 0x9e3779b9u;
+  auto next = [&state]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+
+  std::vector<uchar> rgb888(WIDTH * 3);
+  std::generate(rgb888.begin(), rgb888.end(), [&]() { return uchar(next()); });
+  std::vector<quint32> expected(WIDTH), actual(WIDTH);
+  rgb888ToRgb32Scalar(rgb888.data(), expected.data(), WIDTH);
+  kernels.rgb888ToRgb32(rgb888.data(), actual.data(), WIDTH);
+  if (expected != actual) {
+    return false;
+  }
+
+  std::vector<quint16> rgb48(WIDTH * 3);
+  std::generate(rgb48.begin(), rgb48.end(), [&]() { return quint16(next()); });
+  std::vector<quint16> expected64(WIDTH * 4), actual64(WIDTH * 4);
+  rgb48ToRgbx64Scalar(rgb48.data(), expected64.data(), WIDTH);
+  kernels.rgb48ToRgbx64(rgb48.data(), actual64.data(), WIDTH);
+  if (expected64 != actual64) {
+    return false;
+  }
+
+  QImage image(WIDTH, HEIGHT, QImage::Format_RGB32);
+  for (int y = 0; y < HEIGHT; ++y) {
+    auto *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+    for (int x = 0; x < WIDTH; ++x) {
+      line[x] = 0xff000000u | next();
+    }
+  }
+
+  for (const QSize size : {QSize(67, 20), QSize(29, 7), QSize(1, 1)}) {
+    const QImage reference = downscaleWith(SCALAR_KERNELS, image, size);
+    const QImage candidate = downscaleWith(kernels, image, size);
+    for (int y = 0; y < size.height(); ++y) {
+      const uchar *a = reference.constScanLine(y);
+      const uchar *b = candidate.constScanLine(y);
+      for (int i = 0; i < size.width() * 4; ++i) {
+        if (std::abs(int(a[i]) - int(b[i])) > 1) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+const Kernels &selectKernels() {
+  std::vector<const Kernels *> candidates;
+#ifdef PIXEL_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    candidates.push_back(&AVX2_KERNELS);
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    candidates.push_back(&SSE_KERNELS);
+  }
+#endif
+#ifdef PIXEL_KERNELS_NEON
+  candidates.push_back(&NEON_KERNELS);
+#endif
+
+  for (const auto *kernels : candidates) {
+    if (agreesWithScalar(*kernels)) {
+      return *kernels;
+    }
+    qWarning() << "PixelKernels:" << kernels->name
+               << "kernels disagree with the scalar ones, not using them";
+  }
+  return SCALAR_KERNELS;
+}
+
+const Kernels &activeKernels() {
+  static const Kernels &kernels = selectKernels();
+  return kernels;
+}
+
+} // namespace
+
+void PixelKernels::rgb888ToRgb32(const uchar *source, quint32 *destination,
+                                 int count) {
+  activeKernels().rgb888ToRgb32(source, destination, count);
+}
+
+void PixelKernels::rgb48ToRgbx64(const quint16 *source, quint16 *destination,
+                                 int count) {
+  activeKernels().rgb48ToRgbx64(source, destination, count);
+}
+
+QImage PixelKernels::downscale(const QImage &image, const QSize &size) {
+  Trace::Span span("convert", "downscale");
+  if (image.isNull() || size.isEmpty() || size.width() >= image.width() ||
+      size.height() >= image.height() || isHighBitDepth(image.format())) {
+    return image.scaled(size, Qt::IgnoreAspectRatio,
+                        Qt::SmoothTransformation);
+  }
+  return downscaleWith(activeKernels(), image, size);
+}
+
+void PixelKernels::initialize() { activeKernels(); }
+
+const char *PixelKernels::instructionSet() { return activeKernels().name; }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <QImage>
+#include <QSize>
+#include <QtGlobal>
+
+/// Pixel loops on the decode-to-display path, vectorized.
+///
+/// Each kernel has a scalar version plus SSE4.1 and AVX2 versions on
+/// x86-64 and a NEON version on ARM64. The fastest one the CPU supports
+/// is picked on first use, after checking it against the scalar version
+/// on a synthetic image. A kernel that disagrees is not used.
+class PixelKernels {
+public:
+  /// Packed 8-bit RGB to Format_RGB32, `count` pixels
+  static void rgb888ToRgb32(const uchar *source, quint32 *destination,
+                            int count);
+
+  /// Packed 16-bit RGB to Format_RGBX64, `count` pixels
+  static void rgb48ToRgbx64(const quint16 *source, quint16 *destination,
+                            int count);
+
+  /// Area-averaged reduction to exactly `size`, by any factor. Every
+  /// source pixel counts in proportion to how much of it falls inside
+  /// the destination pixel. Formats with more than 8 bits per channel
+  /// go through QImage::scaled, which keeps their depth. Anything else
+  /// but Format_RGB32 is averaged as premultiplied ARGB32. Sizes that
+  /// are not smaller in both directions fall back to QImage::scaled
+  static QImage downscale(const QImage &image, const QSize &size);
+
+  /// Picks and checks the kernels now instead of on first use
+  static void initialize();
+
+  /// "AVX2", "SSE4.1", "NEON" or "scalar"
+  static const char *instructionSet();
+};
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "Preferences.hpp"
+#include <algorithm>
+#include <limits>
 
 Preferences::Preferences(QWidget *parent) : QWidget(parent) { setupUi(); }
 
@@ -78,6 +80,49 @@ QWidget *Preferences::setupViewTab() {
 
   formLayout->addRow(backgroundLabel, m_colorPickerButton);
 
+  // Decode large images at screen resolution
+  m_screenResolutionDecode =
+      new QCheckBox("Decode large images at screen resolution");
+  if (get(SETTING_SCREEN_RESOLUTION_DECODE, true).toBool()) {
+    m_screenResolutionDecode->setChecked(true);
+  } else {
+    m_screenResolutionDecode->setChecked(false);
+  }
+  connect(m_screenResolutionDecode, &QCheckBox::stateChanged, this,
+          &Preferences::handleEditingFinished_screenResolutionDecode);
+  formLayout->addRow(m_screenResolutionDecode);
+
+  // Memory budget for decoded images
+  QLabel *cacheSizeLabel = new QLabel("Image cache (MB)");
+  m_cacheSize = new QLineEdit;
+  connect(m_cacheSize, &QLineEdit::editingFinished, this,
+          &Preferences::handleEditingFinished_cacheSize);
+  m_cacheSize->setText(QString("%1").arg(
+      get(SETTING_CACHE_SIZE_MB, DEFAULT_CACHE_SIZE_MB).toInt()));
+  formLayout->addRow(cacheSizeLabel, m_cacheSize);
+
+  // Prefetch window
+  m_prefetchAhead = new QLineEdit;
+  m_prefetchAhead->setText(QString("%1").arg(
+      get(SETTING_PREFETCH_AHEAD, DEFAULT_PREFETCH_AHEAD).toInt()));
+  connect(m_prefetchAhead, &QLineEdit::editingFinished, this,
+          &Preferences::handleEditingFinished_prefetch);
+  formLayout->addRow(new QLabel("Prefetch ahead"), m_prefetchAhead);
+
+  m_prefetchBehind = new QLineEdit;
+  m_prefetchBehind->setText(QString("%1").arg(
+      get(SETTING_PREFETCH_BEHIND, DEFAULT_PREFETCH_BEHIND).toInt()));
+  connect(m_prefetchBehind, &QLineEdit::editingFinished, this,
+          &Preferences::handleEditingFinished_prefetch);
+  formLayout->addRow(new QLabel("Prefetch behind"), m_prefetchBehind);
+
+  m_prefetchMemory = new QLineEdit;
+  m_prefetchMemory->setText(QString("%1").arg(
+      get(SETTING_PREFETCH_MEMORY_MB, DEFAULT_PREFETCH_MEMORY_MB).toInt()));
+  connect(m_prefetchMemory, &QLineEdit::editingFinished, this,
+          &Preferences::handleEditingFinished_prefetch);
+  formLayout->addRow(new QLabel("Prefetch memory (MB)"), m_prefetchMemory);
+
   return tab1;
 }
 
@@ -135,9 +180,98 @@ QWidget *Preferences::setupRawTab() {
           &Preferences::handleEditingFinished_autoWb);
   formLayout->addRow(m_rawAutoWb);
 
+  // RAW output bit depth setting
+  m_raw16Bit = new QCheckBox("Keep 16 bits per channel");
+  if (get(SETTING_RAW_16_BIT, false).toBool()) {
+    m_raw16Bit->setChecked(true);
+  } else {
+    m_raw16Bit->setChecked(false);
+  }
+  connect(m_raw16Bit, &QCheckBox::stateChanged, this,
+          &Preferences::handleEditingFinished_16Bit);
+  formLayout->addRow(m_raw16Bit);
+
+  // RAW embedded preview setting
+  m_rawPreviewMode = new QComboBox;
+  m_rawPreviewMode->addItem("Off", RAW_PREVIEW_OFF);
+  m_rawPreviewMode->addItem("Show preview, then full image",
+                            RAW_PREVIEW_THEN_FULL);
+  m_rawPreviewMode->addItem("Show preview, full image on zoom",
+                            RAW_PREVIEW_FULL_ON_ZOOM);
+  m_rawPreviewMode->setCurrentIndex(m_rawPreviewMode->findData(
+      get(SETTING_RAW_PREVIEW_MODE, RAW_PREVIEW_THEN_FULL).toInt()));
+  connect(m_rawPreviewMode, &QComboBox::currentIndexChanged, this,
+          &Preferences::handleEditingFinished_previewMode);
+  formLayout->addRow(new QLabel("Embedded preview"), m_rawPreviewMode);
+
   return tab3;
 }
 
+void Preferences::handleEditingFinished_screenResolutionDecode(int state) {
+  if (state == Qt::Checked) {
+    set(SETTING_SCREEN_RESOLUTION_DECODE, true);
+    qDebug() << "Preferences::Screen resolution decode: True";
+  } else {
+    set(SETTING_SCREEN_RESOLUTION_DECODE, false);
+    qDebug() << "Preferences::Screen resolution decode: False";
+  }
+
+  emit settingChangedScreenResolutionDecode();
+}
+
+void Preferences::handleEditingFinished_cacheSize() {
+  m_cacheSize->clearFocus();
+
+  QString text = m_cacheSize->text();
+  bool ok;
+  int newCacheSize = text.toInt(&ok);
+
+  if (ok) {
+    if (newCacheSize < 0) {
+      newCacheSize = 0; // 0 disables the cache
+    }
+    m_cacheSize->setText(QString("%1").arg(newCacheSize));
+    set(SETTING_CACHE_SIZE_MB, newCacheSize);
+    emit settingChangedCacheSize();
+    qDebug() << "Preferences::Set image cache size to " << newCacheSize
+             << "MB";
+  } else {
+    m_cacheSize->setText(QString("%1").arg(
+        get(SETTING_CACHE_SIZE_MB, DEFAULT_CACHE_SIZE_MB).toInt()));
+    qDebug() << "Preferences::Invalid image cache size";
+  }
+}
+
+void Preferences::handleEditingFinished_prefetch() {
+  auto readField = [](QLineEdit *field, const char *key, int defaultValue,
+                      int maximum) {
+    field->clearFocus();
+
+    bool ok;
+    int value = field->text().toInt(&ok);
+    if (!ok) {
+      value = get(key, defaultValue).toInt();
+    }
+    value = std::clamp(value, 0, maximum);
+
+    field->setText(QString("%1").arg(value));
+    set(key, value);
+    return value;
+  };
+
+  auto ahead = readField(m_prefetchAhead, SETTING_PREFETCH_AHEAD,
+                         DEFAULT_PREFETCH_AHEAD, MAX_PREFETCH_EXTENT);
+  auto behind = readField(m_prefetchBehind, SETTING_PREFETCH_BEHIND,
+                          DEFAULT_PREFETCH_BEHIND, MAX_PREFETCH_EXTENT);
+  auto memory =
+      readField(m_prefetchMemory, SETTING_PREFETCH_MEMORY_MB,
+                DEFAULT_PREFETCH_MEMORY_MB, std::numeric_limits<int>::max());
+
+  emit settingChangedPrefetch();
+  qDebug() << "Preferences::Prefetch " << ahead << "ahead," << behind
+           << "behind," << memory << "MB";
+}
+
 void Preferences::handleEditingFinished_slideshowPeriod() {
   m_slideshowPeriod->clearFocus();
 
@@ -193,5 +327,25 @@ void Preferences::handleEditingFinished_autoWb(int state) {
     qDebug() << "Preferences::RAW auto wb: False";
   }
 
+  emit rawSettingChanged();
+}
+
+void Preferences::handleEditingFinished_16Bit(int state) {
+  if (state == Qt::Checked) {
+    set(SETTING_RAW_16_BIT, true);
+    qDebug() << "Preferences::RAW 16 bit: True";
+  } else {
+    set(SETTING_RAW_16_BIT, false);
+    qDebug() << "Preferences::RAW 16 bit: False";
+  }
+
+  emit rawSettingChanged();
+}
+
+void Preferences::handleEditingFinished_previewMode(int index) {
+  auto mode = m_rawPreviewMode->itemData(index).toInt();
+  set(SETTING_RAW_PREVIEW_MODE, mode);
+  qDebug() << "Preferences::RAW preview mode: " << mode;
+
   emit rawSettingChanged();
 }
\ No newline at end of file
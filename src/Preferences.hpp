@@ -13,6 +13,7 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QPushButton>
+#include <QComboBox>
 
 class Preferences : public QWidget {
     Q_OBJECT
@@ -25,8 +26,16 @@ class Preferences : public QWidget {
     QLineEdit* m_slideshowPeriod;
     QCheckBox* m_slideshowLoop;
 
+    QCheckBox* m_screenResolutionDecode;
+    QLineEdit* m_cacheSize;
+    QLineEdit* m_prefetchAhead;
+    QLineEdit* m_prefetchBehind;
+    QLineEdit* m_prefetchMemory;
+
     QCheckBox* m_rawHalfSize;
     QCheckBox* m_rawAutoWb;
+    QCheckBox* m_raw16Bit;
+    QComboBox* m_rawPreviewMode;
 
 public:
     constexpr static inline char SETTING_PREVIOUS_OPEN_PATH[] = "openPath";
@@ -35,6 +44,26 @@ public:
     constexpr static inline char SETTING_SLIDESHOW_LOOP[] = "slideShowLoopAfterEnd";
     constexpr static inline char SETTING_RAW_HALF_SIZE[] = "rawHalfSize";
     constexpr static inline char SETTING_RAW_AUTO_WB[] = "rawAutoWb";
+    constexpr static inline char SETTING_RAW_PREVIEW_MODE[] = "rawPreviewMode";
+    constexpr static inline char SETTING_RAW_16_BIT[] = "raw16Bit";
+    constexpr static inline char SETTING_SCREEN_RESOLUTION_DECODE[] = "screenResolutionDecode";
+    constexpr static inline char SETTING_CACHE_SIZE_MB[] = "imageCacheSizeMb";
+    constexpr static inline char SETTING_PREFETCH_AHEAD[] = "prefetchAhead";
+    constexpr static inline char SETTING_PREFETCH_BEHIND[] = "prefetchBehind";
+    constexpr static inline char SETTING_PREFETCH_MEMORY_MB[] = "prefetchMemoryMb";
+
+    constexpr static inline int DEFAULT_CACHE_SIZE_MB = 2048;
+    constexpr static inline int DEFAULT_PREFETCH_AHEAD = 4;
+    constexpr static inline int DEFAULT_PREFETCH_BEHIND = 1;
+    constexpr static inline int DEFAULT_PREFETCH_MEMORY_MB = 1024;
+    constexpr static inline int MAX_PREFETCH_EXTENT = 64;
+
+    /// How the JPEG preview embedded in RAW files is used
+    enum RawPreviewMode {
+        RAW_PREVIEW_OFF = 0,          // Always wait for the full decode
+        RAW_PREVIEW_THEN_FULL = 1,    // Show the preview, then the full decode
+        RAW_PREVIEW_FULL_ON_ZOOM = 2, // Full decode only when zooming in
+    };
 
 public:
     Preferences(QWidget *parent = nullptr);
@@ -46,14 +75,22 @@ signals:
     void settingChangedSlideShowPeriod();
     void settingChangedSlideShowLoop();
     void rawSettingChanged();
+    void settingChangedCacheSize();
+    void settingChangedScreenResolutionDecode();
+    void settingChangedPrefetch();
 
 private:
     void setupUi();
     QWidget* setupViewTab();
     QWidget* setupSlideshowTab();
     QWidget* setupRawTab();
+    void handleEditingFinished_screenResolutionDecode(int state);
+    void handleEditingFinished_cacheSize();
+    void handleEditingFinished_prefetch();
     void handleEditingFinished_slideshowPeriod();
     void handleEditingFinished_slideshowLoop(int state);
     void handleEditingFinished_halfSize(int state);
     void handleEditingFinished_autoWb(int state);
+    void handleEditingFinished_16Bit(int state);
+    void handleEditingFinished_previewMode(int index);
 };
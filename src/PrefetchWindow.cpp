@@ -0,0 +1,55 @@
+#include "PrefetchWindow.hpp"
+#include <algorithm>
+
+void PrefetchWindow::setExtent(int ahead, int behind) {
+  m_ahead = std::max(0, ahead);
+  m_behind = std::max(0, behind);
+}
+
+void PrefetchWindow::recordStep(long step) {
+  if (step == 0) {
+    return;
+  }
+
+  /// Older steps decay so the direction follows the user within
+  /// two or three key presses
+  const double sign = step > 0 ? 1.0 : -1.0;
+  m_momentum = m_momentum * 0.5 + sign;
+}
+
+void PrefetchWindow::setSlideshowRunning(bool running) {
+  m_slideshowRunning = running;
+  if (running) {
+    m_momentum = 1.0;
+  }
+}
+
+PrefetchWindow::Direction PrefetchWindow::direction() const {
+  return m_momentum >= 0 ? Direction::forward : Direction::backward;
+}
+
+std::vector<std::size_t> PrefetchWindow::plan(std::size_t current,
+                                              std::size_t count) const {
+  std::vector<std::size_t> result;
+  if (current >= count) {
+    return result;
+  }
+
+  const long step = direction() == Direction::forward ? 1 : -1;
+  const int behind = m_slideshowRunning ? 0 : m_behind;
+
+  auto append = [&](long direction, int extent) {
+    for (int i = 1; i <= extent; ++i) {
+      const long index = static_cast<long>(current) + direction * i;
+      if (index < 0 || index >= static_cast<long>(count)) {
+        break;
+      }
+      result.push_back(static_cast<std::size_t>(index));
+    }
+  };
+
+  append(step, m_ahead);
+  append(-step, behind);
+
+  return result;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include "Preferences.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/// Decides which images around the current one to decode ahead of time
+/// and in what order.
+///
+/// The direction of travel is learned from recent navigation steps so a
+/// single glance backwards doesn't flip the window around. While a
+/// slideshow is running the window only looks ahead.
+class PrefetchWindow {
+public:
+  enum class Direction { forward, backward };
+
+  void setExtent(int ahead, int behind);
+  int ahead() const { return m_ahead; }
+  int behind() const { return m_behind; }
+
+  /// Record a navigation step, e.g. +1 for next, -10 for goBackward
+  void recordStep(long step);
+  void setSlideshowRunning(bool running);
+  Direction direction() const;
+
+  /// Indices to prefetch in priority order: first the images in the
+  /// direction of travel nearest first, then the ones behind.
+  /// The current index itself is not included.
+  std::vector<std::size_t> plan(std::size_t current, std::size_t count) const;
+
+private:
+  int m_ahead{Preferences::DEFAULT_PREFETCH_AHEAD};
+  int m_behind{Preferences::DEFAULT_PREFETCH_BEHIND};
+  double m_momentum{1.0};
+  bool m_slideshowRunning{false};
+};
\ No newline at end of file
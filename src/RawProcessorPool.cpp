@@ -0,0 +1,43 @@
+#include "RawProcessorPool.hpp"
+#include <QMutexLocker>
+#include <QThread>
+
+#include <algorithm>
+
+void RawProcessorPool::Release::operator()(LibRaw *processor) const {
+  RawProcessorPool::instance().release(processor);
+}
+
+RawProcessorPool &RawProcessorPool::instance() {
+  static RawProcessorPool pool;
+  return pool;
+}
+
+/// Image and thumbnail workers together never run more
+/// decodes at once than there are cores
+RawProcessorPool::RawProcessorPool()
+    : m_maxIdle(std::size_t(std::max(QThread::idealThreadCount(), 1))) {}
+
+RawProcessorPool::Handle RawProcessorPool::acquire() {
+  {
+    QMutexLocker locker(&m_mutex);
+    if (!m_idle.empty()) {
+      auto processor = std::move(m_idle.back());
+      m_idle.pop_back();
+      return Handle(processor.release());
+    }
+  }
+  return Handle(new LibRaw);
+}
+
+void RawProcessorPool::release(LibRaw *processor) {
+  std::unique_ptr<LibRaw> owned(processor);
+
+  /// Frees the buffers of the last file outside the lock
+  owned->recycle();
+
+  QMutexLocker locker(&m_mutex);
+  if (m_idle.size() < m_maxIdle) {
+    m_idle.push_back(std::move(owned));
+  }
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include <QMutex>
+#include <libraw/libraw.h>
+
+#include <memory>
+#include <vector>
+
+/// LibRaw instances kept between decodes.
+///
+/// A LibRaw object is large and sets up its tables and memory manager
+/// when constructed, so creating one per file costs time on every RAW
+/// decode. Workers borrow an instance here instead and hand it back
+/// when the handle goes out of scope. It is recycled first, so no state
+/// from the previous file carries over. Every worker holds its own
+/// instance while decoding, so RAW decodes on different workers run in
+/// parallel.
+class RawProcessorPool {
+public:
+  struct Release {
+    void operator()(LibRaw *processor) const;
+  };
+  using Handle = std::unique_ptr<LibRaw, Release>;
+
+  static RawProcessorPool &instance();
+
+  Handle acquire();
+
+private:
+  RawProcessorPool();
+
+  void release(LibRaw *processor);
+
+  QMutex m_mutex;
+  std::vector<std::unique_ptr<LibRaw>> m_idle;
+  std::size_t m_maxIdle;
+};
\ No newline at end of file
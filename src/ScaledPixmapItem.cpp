@@ -0,0 +1,189 @@
+#include "ScaledPixmapItem.hpp"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+#include "PixelKernels.hpp"
+#include "Trace.hpp"
+
+#include <cmath>
+
+ScaledPixmapItem::ScaledPixmapItem(QGraphicsItem *parent)
+    : QGraphicsObject(parent) {
+  // Needed for exposedRect to be the visible part instead of everything
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+
+  // One render at a time, a newer one replaces it anyway
+  m_pool.setMaxThreadCount(1);
+
+  m_idleTimer.setSingleShot(true);
+  connect(&m_idleTimer, &QTimer::timeout, this,
+          &ScaledPixmapItem::startRender);
+}
+
+ScaledPixmapItem::~ScaledPixmapItem() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+void ScaledPixmapItem::setPixmap(const QPixmap &pixmap) {
+  prepareGeometryChange();
+  m_pixmap = pixmap;
+  m_image = QImage();
+  m_render = Render();
+  m_idleTimer.stop();
+  ++m_generation;
+  m_animating = false;
+  update();
+}
+
+void ScaledPixmapItem::setFrame(const QPixmap &frame) {
+  if (frame.size() != m_pixmap.size()) {
+    prepareGeometryChange();
+  }
+  m_pixmap = frame;
+  m_image = QImage();
+  m_render = Render();
+  m_idleTimer.stop();
+  ++m_generation;
+  m_animating = true;
+  update();
+}
+
+void ScaledPixmapItem::setOffset(const QPointF &offset) {
+  if (offset == m_offset) {
+    return;
+  }
+  prepareGeometryChange();
+  m_offset = offset;
+  update();
+}
+
+QRectF ScaledPixmapItem::boundingRect() const {
+  return QRectF(m_offset, QSizeF(m_pixmap.size()));
+}
+
+void ScaledPixmapItem::paint(QPainter *painter,
+                             const QStyleOptionGraphicsItem *option,
+                             QWidget *widget) {
+  if (m_pixmap.isNull()) {
+    return;
+  }
+  Trace::Span span("paint", "pixmap");
+
+  if (!widget || m_animating) {
+    // Not on screen or about to be replaced, nothing to cache for
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawPixmap(m_offset, m_pixmap);
+    return;
+  }
+
+  const QTransform deviceTransform = painter->deviceTransform();
+  const qreal scale = option->levelOfDetailFromTransform(deviceTransform);
+  const QRectF exposed = option->exposedRect & boundingRect();
+  const QRectF rendered = QRectF(m_render.sourceRect).translated(m_offset);
+  const bool hasRender =
+      !m_render.pixmap.isNull() && rendered.contains(exposed);
+
+  if (hasRender && qFuzzyCompare(m_render.scale, scale)) {
+    // Device pixels line up with the render's pixels, draw it with a
+    // translation only so the paint engine copies instead of sampling
+    const qreal dpr = painter->device()->devicePixelRatioF();
+    const QPointF topLeft = deviceTransform.map(rendered.topLeft());
+    painter->save();
+    painter->setWorldTransform(QTransform(1.0 / dpr, 0, 0, 1.0 / dpr,
+                                          std::round(topLeft.x()) / dpr,
+                                          std::round(topLeft.y()) / dpr));
+    painter->drawPixmap(0, 0, m_render.pixmap);
+    painter->restore();
+    return;
+  }
+
+  // Nothing rendered yet means a new pixmap, which should not show up
+  // aliased. Draw it smoothly once and render it right away
+  const bool firstFrame = m_render.pixmap.isNull();
+
+  if (hasRender) {
+    // Zooming, stretch the render that is already there
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawPixmap(rendered, m_render.pixmap,
+                        QRectF(m_render.pixmap.rect()));
+  } else {
+    // Nearest neighbour only reads one pixmap pixel per device pixel
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, firstFrame);
+    painter->drawPixmap(exposed, m_pixmap, exposed.translated(-m_offset));
+  }
+
+  // The whole view plus a margin, in pixmap pixels
+  const QSizeF viewSize =
+      QSizeF(widget->size()) * painter->device()->devicePixelRatioF();
+  const QRectF view = QRectF(QPointF(0, 0), viewSize)
+                          .adjusted(-viewSize.width() * RENDER_MARGIN,
+                                    -viewSize.height() * RENDER_MARGIN,
+                                    viewSize.width() * RENDER_MARGIN,
+                                    viewSize.height() * RENDER_MARGIN);
+  m_wantedScale = scale;
+  m_wantedRect = deviceTransform.inverted()
+                     .mapRect(view)
+                     .translated(-m_offset)
+                     .toAlignedRect() &
+                 m_pixmap.rect();
+
+  // Restarted on every frame, so the render waits until the user stops
+  m_idleTimer.start(firstFrame ? 0 : IDLE_MS);
+}
+
+void ScaledPixmapItem::startRender() {
+  if (m_wantedRect.isEmpty() || m_wantedScale <= 0.0) {
+    return;
+  }
+
+  if (m_image.isNull()) {
+    // A raster pixmap hands out its image without copying
+    m_image = m_pixmap.toImage();
+  }
+
+  m_pool.clear();
+  m_pool.start([this, generation = ++m_generation, image = m_image,
+                scale = m_wantedScale, sourceRect = m_wantedRect]() {
+    Trace::Span span("paint", "render zoom level");
+
+    // Read the area in place when its rows can be addressed directly
+    QImage area =
+        image.depth() == 32
+            ? QImage(image.constScanLine(sourceRect.y()) + sourceRect.x() * 4,
+                     sourceRect.width(), sourceRect.height(),
+                     image.bytesPerLine(), image.format())
+            : image.copy(sourceRect);
+
+    const QSize size =
+        (QSizeF(sourceRect.size()) * scale).toSize().expandedTo(QSize(1, 1));
+
+    // Same size would share the pixels, which belong to the pixmap
+    QImage rendered = size == area.size()
+                          ? area.copy()
+                          : PixelKernels::downscale(area, size);
+
+    QMetaObject::invokeMethod(
+        this,
+        [this, generation, scale, sourceRect, rendered]() {
+          onRendered(generation, scale, sourceRect, rendered);
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void ScaledPixmapItem::onRendered(quint64 generation, qreal scale,
+                                  const QRect &sourceRect,
+                                  const QImage &image) {
+  if (generation != m_generation || image.isNull()) {
+    return;
+  }
+
+  m_render.scale = scale;
+  m_render.sourceRect = sourceRect;
+  {
+    Trace::Span span("convert", "QPixmap::fromImage");
+    m_render.pixmap = QPixmap::fromImage(image);
+  }
+  update();
+}
\ No newline at end of file
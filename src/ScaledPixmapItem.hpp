@@ -0,0 +1,71 @@
+#pragma once
+#include <QGraphicsObject>
+#include <QImage>
+#include <QPixmap>
+#include <QRect>
+#include <QThreadPool>
+#include <QTimer>
+
+/// Draws a pixmap through a render cache, so zooming and panning do not
+/// resample the whole pixmap on every frame.
+///
+/// The cache holds the part of the pixmap around the view, resampled at
+/// the current zoom level. Painting at that zoom is then a 1:1 copy to
+/// the screen. While zoom or position change, the item draws a cheap
+/// preview instead. That is either the cached render stretched
+/// bilinearly, or the pixmap itself with nearest-neighbour sampling. A
+/// high quality render of the new view starts on a worker once nothing
+/// has changed for IDLE_MS. Reductions use the area-averaging kernels.
+class ScaledPixmapItem : public QGraphicsObject {
+  Q_OBJECT
+
+  static constexpr inline int IDLE_MS = 150;
+
+  /// Part of the view size rendered beyond each edge of the view,
+  /// so small pans stay inside the cache
+  static constexpr inline qreal RENDER_MARGIN = 0.25;
+
+  QPixmap m_pixmap;
+  QImage m_image; // shares the pixels of m_pixmap, read by the workers
+  QPointF m_offset;
+
+  struct Render {
+    qreal scale{0.0}; // device pixels per pixmap pixel
+    QRect sourceRect; // in pixmap pixels
+    QPixmap pixmap;
+  };
+  Render m_render;
+
+  /// What the view last needed, rendered once the view stops changing
+  qreal m_wantedScale{0.0};
+  QRect m_wantedRect;
+  QTimer m_idleTimer;
+
+  /// Bumped for every render started and whenever the pixmap changes.
+  /// Results of older renders are dropped
+  quint64 m_generation{0};
+  QThreadPool m_pool;
+
+  /// Showing animation frames, which change too often to be rendered
+  bool m_animating{false};
+
+public:
+  ScaledPixmapItem(QGraphicsItem *parent = nullptr);
+  ~ScaledPixmapItem();
+
+  void setPixmap(const QPixmap &pixmap);
+
+  /// The next frame of an animation, drawn as it is without a render
+  void setFrame(const QPixmap &frame);
+  QPixmap pixmap() const { return m_pixmap; }
+  void setOffset(const QPointF &offset);
+
+  QRectF boundingRect() const override;
+  void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+             QWidget *widget = nullptr) override;
+
+private:
+  void startRender();
+  void onRendered(quint64 generation, qreal scale, const QRect &sourceRect,
+                  const QImage &image);
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "SlideshowScheduler.hpp"
+#include <algorithm>
+#include <cmath>
+
+void SlideshowScheduler::start(qint64 now, int periodMs, bool loop) {
+  m_running = true;
+  m_loop = loop;
+  m_waiting = false;
+  m_period = std::max(1, periodMs);
+  m_nextDeadline = now + m_period;
+  m_framesShown = 0;
+  m_missedDeadlines = 0;
+}
+
+void SlideshowScheduler::stop() {
+  m_running = false;
+  m_waiting = false;
+}
+
+void SlideshowScheduler::setPeriod(int periodMs) {
+  const qint64 period = std::max(1, periodMs);
+
+  /// The frame on screen keeps the time it has already been up
+  m_nextDeadline += period - m_period;
+  m_period = period;
+}
+
+bool SlideshowScheduler::next(std::size_t current, std::size_t count,
+                              std::size_t &index) const {
+  if (count == 0) {
+    return false;
+  }
+  if (current + 1 < count) {
+    index = current + 1;
+    return true;
+  }
+  index = 0;
+  return m_loop;
+}
+
+std::vector<std::size_t> SlideshowScheduler::plan(std::size_t current,
+                                                  std::size_t count) const {
+  std::vector<std::size_t> result;
+  std::size_t index = current;
+  for (int i = 0; i < framesAhead(); ++i) {
+    if (!next(index, count, index) || index == current) {
+      /// The end, or a folder with fewer images than frames ahead
+      break;
+    }
+    result.push_back(index);
+  }
+  return result;
+}
+
+void SlideshowScheduler::recordDecode(qint64 durationMs) {
+  /// Moving average, one slow file should not double the look-ahead
+  m_decodeEstimate = m_decodeEstimate == 0.0
+                         ? double(durationMs)
+                         : 0.75 * m_decodeEstimate + 0.25 * durationMs;
+}
+
+int SlideshowScheduler::framesAhead() const {
+  /// Frame n + k is requested when frame n is shown
+  /// and is due k periods later
+  const int frames =
+      int(std::ceil(DECODE_MARGIN * m_decodeEstimate / double(m_period))) + 1;
+  return std::clamp(frames, MIN_FRAMES_AHEAD, MAX_FRAMES_AHEAD);
+}
+
+void SlideshowScheduler::frameDue(qint64 now, bool ready) {
+  ++m_framesShown;
+  if (!ready) {
+    ++m_missedDeadlines;
+    m_waiting = true;
+    return;
+  }
+
+  /// After a stall, e.g. a suspended machine, start over
+  /// instead of catching up with a burst of frames
+  m_nextDeadline += m_period;
+  if (m_nextDeadline <= now) {
+    m_nextDeadline = now + m_period;
+  }
+}
+
+void SlideshowScheduler::frameShown(qint64 now) {
+  if (m_waiting) {
+    m_waiting = false;
+    m_nextDeadline = now + m_period;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+#include <QtGlobal>
+
+#include <cstddef>
+#include <vector>
+
+/// Plans a slideshow against the times its frames are due.
+///
+/// Deadlines are a fixed period apart, counted from the previous
+/// deadline rather than from when the timer last ran, so the slideshow
+/// does not drift. Decodes are requested far enough ahead to finish
+/// before their deadlines. How far follows a running estimate of the
+/// decode time. A looping slideshow plans past the last image into the
+/// first ones, so the wrap-around finds them decoded.
+///
+/// A frame that is not decoded when it is due counts as a missed
+/// deadline. The schedule then waits for it and restarts once it is
+/// shown, so every frame still stays up for a whole period.
+class SlideshowScheduler {
+public:
+  static constexpr inline int MIN_FRAMES_AHEAD = 2;
+  static constexpr inline int MAX_FRAMES_AHEAD = 8;
+
+  /// Decodes are planned to finish this many times
+  /// their estimated duration before they are due
+  static constexpr inline double DECODE_MARGIN = 1.5;
+
+  /// Times are in ms of one monotonic clock, whichever the caller uses
+  void start(qint64 now, int periodMs, bool loop);
+  void stop();
+  bool isRunning() const { return m_running; }
+
+  void setPeriod(int periodMs);
+  void setLoop(bool loop) { m_loop = loop; }
+
+  qint64 nextDeadline() const { return m_nextDeadline; }
+
+  /// Waiting for a late frame, there is no deadline until it is shown
+  bool isWaiting() const { return m_waiting; }
+
+  /// Frame shown after `current`. False at the end of a slideshow
+  /// that does not loop
+  bool next(std::size_t current, std::size_t count, std::size_t &index) const;
+
+  /// Frames after `current` to decode ahead, earliest deadline first
+  std::vector<std::size_t> plan(std::size_t current, std::size_t count) const;
+
+  void recordDecode(qint64 durationMs);
+  int framesAhead() const;
+
+  /// The next frame is due, `ready` if it was decoded in time
+  void frameDue(qint64 now, bool ready);
+
+  /// A frame is on screen, which ends the wait for a late one
+  void frameShown(qint64 now);
+
+  int framesShown() const { return m_framesShown; }
+  int missedDeadlines() const { return m_missedDeadlines; }
+
+private:
+  bool m_running{false};
+  bool m_loop{false};
+  bool m_waiting{false};
+  qint64 m_period{2500};
+  qint64 m_nextDeadline{0};
+  double m_decodeEstimate{0.0}; // ms
+  int m_framesShown{0};
+  int m_missedDeadlines{0};
+};
\ No newline at end of file
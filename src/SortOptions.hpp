@@ -8,5 +8,7 @@ enum class SortOrder {
 enum class SortBy {
 	name,
 	size,
-	date_modified
+	date_modified,
+	capture_time,
+	camera
 };
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "ThumbnailModel.hpp"
+#include <QFileInfo>
+#include <QTransform>
+
+#include "DiskCache.hpp"
+#include "ExifReader.hpp"
+#include "ImageLoader.hpp"
+#include "PixelKernels.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+namespace {
+
+/// EXIF thumbnails are stored unrotated like the image itself
+QImage applyOrientation(const QImage &image, int orientation) {
+  QTransform transform;
+  switch (orientation) {
+  case 2:
+    transform.scale(-1, 1);
+    break;
+  case 3:
+    transform.rotate(180);
+    break;
+  case 4:
+    transform.scale(1, -1);
+    break;
+  case 5:
+    transform.rotate(90);
+    transform.scale(-1, 1);
+    break;
+  case 6:
+    transform.rotate(90);
+    break;
+  case 7:
+    transform.rotate(270);
+    transform.scale(-1, 1);
+    break;
+  case 8:
+    transform.rotate(270);
+    break;
+  default:
+    return image;
+  }
+  return image.transformed(transform);
+}
+
+} // namespace
+
+ThumbnailModel::ThumbnailModel(int thumbnailSize, QObject *parent)
+    : QAbstractListModel(parent), m_thumbnailSize(thumbnailSize),
+      m_decodePool(std::max(1, QThread::idealThreadCount() / 2)),
+      m_thumbnails(THUMBNAIL_CACHE_KB) {
+  m_placeholder = QPixmap(thumbnailSize, thumbnailSize);
+  m_placeholder.fill(Qt::transparent);
+}
+
+int ThumbnailModel::rowCount(const QModelIndex &parent) const {
+  if (parent.isValid()) {
+    return 0;
+  }
+  return static_cast<int>(m_imageFiles.size() -
+                          (m_pendingRows.size() - m_announcedRows));
+}
+
+std::size_t ThumbnailModel::sourceRow(int row) const {
+  /// A pending row shifts the rows from its own on by one. The j-th
+  /// still pending one shifts model row r if pending[j] - j <= r,
+  /// which only grows with j, so the count is a binary search
+  auto low = m_announcedRows;
+  auto high = m_pendingRows.size();
+  while (low < high) {
+    const auto middle = (low + high) / 2;
+    if (m_pendingRows[middle] - (middle - m_announcedRows) <=
+        std::size_t(row)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return std::size_t(row) + (low - m_announcedRows);
+}
+
+QVariant ThumbnailModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= rowCount()) {
+    return {};
+  }
+
+  const auto row = sourceRow(index.row());
+  const auto &imagePath = m_imageFiles.path(row);
+
+  if (role == Qt::DecorationRole) {
+    const auto *thumbnail = m_thumbnails.object(thumbnailKey(index.row()));
+    if (thumbnail) {
+      return *thumbnail;
+    }
+
+    /// data() is const in the model API, the request it starts is not
+    const_cast<ThumbnailModel *>(this)->requestThumbnail(index.row());
+    return m_placeholder;
+  }
+
+  if (role == Qt::ToolTipRole) {
+    const auto &metadata = m_imageFiles.metadata(row);
+    auto toolTip = QFileInfo(imagePath).fileName();
+    if (metadata.width > 0) {
+      toolTip +=
+          QString(" (%1 x %2)").arg(metadata.width).arg(metadata.height);
+    }
+    return toolTip;
+  }
+
+  return {};
+}
+
+QModelIndex ThumbnailModel::indexOf(const QString &imagePath) const {
+  auto row = m_imageFiles.indexOf(imagePath);
+  if (!row) {
+    return {};
+  }
+
+  /// Rows not announced yet have no index, later ones move up
+  const auto first =
+      m_pendingRows.begin() + std::ptrdiff_t(m_announcedRows);
+  const auto pending = std::lower_bound(first, m_pendingRows.end(), *row);
+  if (pending != m_pendingRows.end() && *pending == *row) {
+    return {};
+  }
+  return index(static_cast<int>(*row - std::size_t(pending - first)));
+}
+
+QString ThumbnailModel::path(const QModelIndex &index) const {
+  if (!index.isValid() || index.row() >= rowCount()) {
+    return {};
+  }
+  return m_imageFiles.path(sourceRow(index.row()));
+}
+
+void ThumbnailModel::setImageFiles(
+    const ImageFileIndex::Snapshot &imageFiles) {
+  beginResetModel();
+  m_imageFiles = *imageFiles;
+  endResetModel();
+
+  cancelOffscreenRequests();
+}
+
+void ThumbnailModel::sortImageFiles(
+    const ImageFileIndex::Snapshot &imageFiles) {
+  /// Thumbnails are not cached by row, so a re-sort keeps them.
+  /// Persistent indexes, the selection among them, follow their files
+  emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+  const auto before = persistentIndexList();
+  QStringList paths;
+  paths.reserve(before.size());
+  for (const auto &modelIndex : before) {
+    paths.append(path(modelIndex));
+  }
+
+  m_imageFiles = *imageFiles;
+
+  QModelIndexList after;
+  after.reserve(paths.size());
+  for (const auto &imagePath : paths) {
+    after.append(indexOf(imagePath));
+  }
+  changePersistentIndexList(before, after);
+  emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+
+  cancelOffscreenRequests();
+}
+
+void ThumbnailModel::insertImageFiles(const ImageFileIndex &batch, SortBy by,
+                                      SortOrder order) {
+  std::vector<QString> added;
+  added.reserve(batch.size());
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    if (!m_imageFiles.contains(batch.path(i))) {
+      added.push_back(batch.path(i));
+    }
+  }
+  if (added.empty()) {
+    return;
+  }
+
+  /// Merged in place, in linear time and without copying the list
+  m_imageFiles.merge(batch, by, order);
+
+  std::vector<std::size_t> rows;
+  rows.reserve(added.size());
+  for (const auto &imagePath : added) {
+    if (auto row = m_imageFiles.indexOf(imagePath)) {
+      rows.push_back(*row);
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+
+  /// The views see the new rows arrive run by run, lowest first, with
+  /// one beginInsertRows() each. Until a run is announced its rows are
+  /// left out, see sourceRow()
+  m_pendingRows = std::move(rows);
+  m_announcedRows = 0;
+  while (m_announcedRows < m_pendingRows.size()) {
+    const auto first = m_pendingRows[m_announcedRows];
+    auto last = first;
+    auto end = m_announcedRows + 1;
+    while (end < m_pendingRows.size() && m_pendingRows[end] == last + 1) {
+      ++last;
+      ++end;
+    }
+
+    beginInsertRows({}, int(first), int(last));
+    m_announcedRows = end;
+    endInsertRows();
+  }
+  m_pendingRows.clear();
+  m_announcedRows = 0;
+}
+
+void ThumbnailModel::removeImageFiles(const QStringList &paths) {
+  for (const auto &imagePath : paths) {
+    auto row = m_imageFiles.indexOf(imagePath);
+    if (!row) {
+      continue;
+    }
+    beginRemoveRows({}, int(*row), int(*row));
+    m_imageFiles.remove(*row);
+    endRemoveRows();
+  }
+}
+
+void ThumbnailModel::cancelOffscreenRequests() {
+  m_decodePool.advanceGeneration();
+}
+
+ImageCacheKey ThumbnailModel::thumbnailKey(int row) const {
+  const auto source = sourceRow(row);
+  return {m_imageFiles.path(source), m_imageFiles.lastModified(source), 0};
+}
+
+void ThumbnailModel::requestThumbnail(int row) {
+  const auto key = thumbnailKey(row);
+
+  auto it = m_pendingThumbnails.find(key);
+  if (it != m_pendingThumbnails.end()) {
+    /// Still on screen, keep it alive
+    m_decodePool.renew(it.value());
+    return;
+  }
+
+  auto ticket = m_decodePool.makeTicket();
+  m_pendingThumbnails.insert(key, ticket);
+
+  const auto fileSize = m_imageFiles.fileSize(sourceRow(row));
+  const auto thumbnailSize = m_thumbnailSize;
+
+  /// Same priority for every row, so rows load in the order painted
+  m_decodePool.submit(
+      ticket, 0,
+      [this, key, ticket, fileSize, thumbnailSize]() {
+        auto thumbnail = loadThumbnail(key.path, fileSize, key.lastModified);
+        if (thumbnail.width() > thumbnailSize ||
+            thumbnail.height() > thumbnailSize) {
+          thumbnail = PixelKernels::downscale(
+              thumbnail, thumbnail.size().scaled(thumbnailSize, thumbnailSize,
+                                                 Qt::KeepAspectRatio));
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, key, ticket, thumbnail]() {
+              onThumbnailLoaded(key, ticket, thumbnail);
+            },
+            Qt::QueuedConnection);
+      },
+      [this, key, ticket]() {
+        QMetaObject::invokeMethod(
+            this, [this, key, ticket]() { onThumbnailDropped(key, ticket); },
+            Qt::QueuedConnection);
+      });
+}
+
+void ThumbnailModel::onThumbnailLoaded(const ImageCacheKey &key,
+                                       const DecodePool::Ticket &ticket,
+                                       const QImage &thumbnail) {
+  if (m_pendingThumbnails.value(key) == ticket) {
+    m_pendingThumbnails.remove(key);
+  }
+
+  /// A file that fails to decode keeps the placeholder
+  /// rather than being requested on every repaint
+  auto *pixmap = thumbnail.isNull() ? new QPixmap(m_placeholder)
+                                    : new QPixmap(QPixmap::fromImage(thumbnail));
+  const auto cost =
+      std::max<qint64>(1, qint64(pixmap->width()) * pixmap->height() *
+                              pixmap->depth() / 8 / 1024);
+  m_thumbnails.insert(key, pixmap, cost);
+
+  updateRow(key.path);
+}
+
+void ThumbnailModel::onThumbnailDropped(const ImageCacheKey &key,
+                                        const DecodePool::Ticket &ticket) {
+  if (m_pendingThumbnails.value(key) == ticket) {
+    m_pendingThumbnails.remove(key);
+  }
+
+  /// Dropped between the scroll and the repaint that would have
+  /// renewed it. Views only repaint the row if it is visible, which
+  /// requests it again
+  updateRow(key.path);
+}
+
+void ThumbnailModel::updateRow(const QString &imagePath) {
+  auto modelIndex = indexOf(imagePath);
+  if (modelIndex.isValid()) {
+    emit dataChanged(modelIndex, modelIndex, {Qt::DecorationRole});
+  }
+}
+
+QImage ThumbnailModel::loadThumbnail(const QString &imagePath,
+                                     qint64 fileSize, qint64 lastModified) {
+  Trace::Span span("decode", "thumbnail", QFileInfo(imagePath).fileName());
+  auto &diskCache = DiskCache::instance();
+
+  QImage thumbnail = diskCache.thumbnail(imagePath, fileSize, lastModified);
+  if (!thumbnail.isNull()) {
+    return thumbnail;
+  }
+
+  CachedMetadata metadata;
+  diskCache.lookup(imagePath, fileSize, lastModified, metadata);
+
+  /// The EXIF thumbnail is small but already compressed for this,
+  /// decoding it is far cheaper than any decode of the image
+  const auto exif = ExifReader::read(imagePath);
+  if (!exif.thumbnail.isEmpty()) {
+    thumbnail = applyOrientation(QImage::fromData(exif.thumbnail, "JPG"),
+                                 exif.orientation);
+  }
+
+  if (thumbnail.isNull()) {
+    /// Embedded preview for RAW, a DCT-scaled decode for JPEG
+    DecodeOptions options;
+    options.rawEmbeddedPreview = true;
+    options.targetSize =
+        QSize(DiskCache::THUMBNAIL_SIZE, DiskCache::THUMBNAIL_SIZE);
+
+    QPixmap imagePixmap;
+    const auto imageInfo =
+        ImageLoader::loadImageIntoPixmap(imagePath, options, imagePixmap);
+    thumbnail = imagePixmap.toImage();
+    metadata.width = imageInfo.width;
+    metadata.height = imageInfo.height;
+  }
+
+  if (thumbnail.isNull()) {
+    return {};
+  }
+
+  metadata.orientation = exif.orientation;
+  metadata.captureTime = exif.captureTime;
+  metadata.camera = exif.camera;
+  metadata.sequence = exif.imageNumber;
+  diskCache.store(imagePath, fileSize, lastModified, metadata, thumbnail);
+
+  return thumbnail;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+#include <QAbstractListModel>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QString>
+
+#include "DecodePool.hpp"
+#include "ImageCache.hpp"
+#include "ImageFileIndex.hpp"
+#include "SortOptions.hpp"
+
+#include <vector>
+
+/// List model over the open directory, shown by the filmstrip and the
+/// thumbnail grid.
+///
+/// Views only ask for the rows they paint, so only those rows request a
+/// thumbnail. Requests run on a DecodePool: scrolling advances its
+/// generation, rows that are still on screen renew their tickets when
+/// they are repainted, and workers drop the rest before decoding.
+///
+/// The list mirrors the loader's. Files inserted, removed or re-sorted
+/// there arrive as changes and are announced to the views as row
+/// inserts, removals and a layout change, so the views keep their
+/// scroll position and selection while a folder streams in.
+///
+/// Thumbnails come from the DiskCache first, then from the EXIF
+/// thumbnail or the embedded RAW preview, and only then from a scaled
+/// decode. Results are stored back in the DiskCache.
+class ThumbnailModel : public QAbstractListModel {
+  Q_OBJECT
+
+  /// Upper bound for the thumbnails kept in memory
+  static constexpr inline int THUMBNAIL_CACHE_KB = 128 * 1024;
+
+  ImageFileIndex m_imageFiles;
+
+  /// Rows of m_imageFiles not yet announced to the views, ascending.
+  /// Only set while insertImageFiles() is announcing rows, from
+  /// m_announcedRows on
+  std::vector<std::size_t> m_pendingRows;
+  std::size_t m_announcedRows{0};
+
+  int m_thumbnailSize;
+  QPixmap m_placeholder;
+
+  DecodePool m_decodePool;
+  /// Keyed by path and modification time, so a file
+  /// written over gets a new thumbnail
+  QHash<ImageCacheKey, DecodePool::Ticket> m_pendingThumbnails;
+  QCache<ImageCacheKey, QPixmap> m_thumbnails;
+
+  std::size_t sourceRow(int row) const;
+  ImageCacheKey thumbnailKey(int row) const;
+  void requestThumbnail(int row);
+  void onThumbnailLoaded(const ImageCacheKey &key,
+                         const DecodePool::Ticket &ticket,
+                         const QImage &thumbnail);
+  void onThumbnailDropped(const ImageCacheKey &key,
+                          const DecodePool::Ticket &ticket);
+  void updateRow(const QString &imagePath);
+  static QImage loadThumbnail(const QString &imagePath, qint64 fileSize,
+                              qint64 lastModified);
+
+public:
+  explicit ThumbnailModel(int thumbnailSize, QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+
+  QModelIndex indexOf(const QString &imagePath) const;
+  QString path(const QModelIndex &index) const;
+
+public slots:
+  /// A new list, e.g. of another folder. Resets the views
+  void setImageFiles(const ImageFileIndex::Snapshot &imageFiles);
+
+  /// The same files in another order
+  void sortImageFiles(const ImageFileIndex::Snapshot &imageFiles);
+
+  /// Merges the batch the way the loader did
+  void insertImageFiles(const ImageFileIndex &batch, SortBy by,
+                        SortOrder order);
+  void removeImageFiles(const QStringList &paths);
+
+  /// Called on scroll. Queued requests are dropped unless the view
+  /// asks for their rows again before a worker gets to them
+  void cancelOffscreenRequests();
+};
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "TiledImageItem.hpp"
+#include <QImageReader>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QThread>
+
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TiledImageItem::TiledImageItem(QGraphicsItem *parent)
+    : QGraphicsObject(parent) {
+  // Needed for exposedRect to be the visible part instead of everything
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+  m_tiles.setMaxCost(TILE_CACHE_KB);
+  m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+TiledImageItem::~TiledImageItem() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+void TiledImageItem::setSource(const QString &imagePath,
+                               const QSize &imageSize, qreal proxyScale) {
+  prepareGeometryChange();
+  clear();
+
+  m_imagePath = imagePath;
+  m_imageSize = imageSize;
+  m_proxyScale = proxyScale;
+
+  // Smallest level fits in a single tile
+  m_levels = 1;
+  while ((std::max(imageSize.width(), imageSize.height()) >>
+          (m_levels - 1)) > TILE_SIZE) {
+    ++m_levels;
+  }
+
+  update();
+}
+
+void TiledImageItem::clear() {
+  ++m_sourceId;
+  ++m_generation;
+  m_pool.clear();
+  m_tiles.clear();
+  m_pendingTiles.clear();
+  m_visibleTilesKey = 0;
+  m_imagePath.clear();
+}
+
+QRectF TiledImageItem::boundingRect() const {
+  return QRectF(-m_imageSize.width() / 2.0, -m_imageSize.height() / 2.0,
+                m_imageSize.width(), m_imageSize.height());
+}
+
+quint64 TiledImageItem::tileKey(int level, int x, int y) {
+  return (quint64(level) << 56) | (quint64(x) << 28) | quint64(y);
+}
+
+QRect TiledImageItem::tileRect(int level, int x, int y) const {
+  const int span = TILE_SIZE << level;
+  return QRect(x * span, y * span, span, span) &
+         QRect(QPoint(0, 0), m_imageSize);
+}
+
+void TiledImageItem::paint(QPainter *painter,
+                           const QStyleOptionGraphicsItem *option,
+                           QWidget *widget) {
+  Q_UNUSED(widget);
+  Trace::Span span("paint", "tiles");
+
+  if (!hasSource()) {
+    return;
+  }
+
+  // Device pixels per full resolution pixel
+  const qreal lod =
+      option->levelOfDetailFromTransform(painter->worldTransform());
+  if (lod <= m_proxyScale) {
+    // The proxy pixmap underneath already has enough detail
+    return;
+  }
+
+  // Coarsest level that still has at least one pixel per device pixel
+  int level = 0;
+  if (lod < 1.0) {
+    level = std::min(m_levels - 1,
+                     static_cast<int>(std::floor(std::log2(1.0 / lod))));
+  }
+
+  const QPointF origin(m_imageSize.width() / 2.0, m_imageSize.height() / 2.0);
+  const QRectF exposed = option->exposedRect.translated(origin) &
+                         QRectF(QPointF(0, 0), QSizeF(m_imageSize));
+  if (exposed.isEmpty()) {
+    return;
+  }
+
+  const qreal span = TILE_SIZE << level;
+  const int x0 = static_cast<int>(std::floor(exposed.left() / span));
+  const int y0 = static_cast<int>(std::floor(exposed.top() / span));
+  const int x1 = static_cast<int>(std::ceil(exposed.right() / span)) - 1;
+  const int y1 = static_cast<int>(std::ceil(exposed.bottom() / span)) - 1;
+
+  // Moving to different tiles makes queued decodes for the old ones stale
+  const quint64 visibleTilesKey = qHashMulti(0, level, x0, y0, x1, y1);
+  if (visibleTilesKey != m_visibleTilesKey) {
+    m_visibleTilesKey = visibleTilesKey;
+    ++m_generation;
+  }
+
+  painter->setRenderHint(QPainter::SmoothPixmapTransform);
+
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      if (auto *tile = m_tiles.object(tileKey(level, x, y))) {
+        painter->drawImage(QRectF(tileRect(level, x, y)).translated(-origin),
+                           *tile);
+      } else {
+        requestTile(level, x, y);
+      }
+    }
+  }
+}
+
+void TiledImageItem::requestTile(int level, int x, int y) {
+  const auto key = tileKey(level, x, y);
+  if (m_pendingTiles.contains(key)) {
+    return;
+  }
+  m_pendingTiles.insert(key);
+
+  const auto clipRect = tileRect(level, x, y);
+  const QSize scaledSize((clipRect.width() + (1 << level) - 1) >> level,
+                         (clipRect.height() + (1 << level) - 1) >> level);
+
+  m_pool.start([this, key, clipRect, scaledSize, imagePath = m_imagePath,
+                sourceId = m_sourceId, generation = m_generation.load()]() {
+    if (generation != m_generation.load()) {
+      // Scrolled out of view before a worker got to it
+      QMetaObject::invokeMethod(
+          this, [this, sourceId, key]() { onTileDropped(sourceId, key); },
+          Qt::QueuedConnection);
+      return;
+    }
+
+    Trace::Span span("decode", "tile");
+
+    // Clip before scaling, so only the tile's region is decoded.
+    // Every tile maps the file anew, which costs no more than an
+    // open and shares the page cache with the other tiles
+    MappedFile mappedFile(imagePath);
+    QImageReader imageReader;
+    if (mappedFile.isValid()) {
+      imageReader.setDevice(mappedFile.device());
+    } else {
+      imageReader.setFileName(imagePath);
+    }
+    imageReader.setAllocationLimit(0);
+    imageReader.setClipRect(clipRect);
+    imageReader.setScaledSize(scaledSize);
+    QImage tile = imageReader.read();
+
+    QMetaObject::invokeMethod(
+        this,
+        [this, sourceId, key, tile]() { onTileDecoded(sourceId, key, tile); },
+        Qt::QueuedConnection);
+  });
+}
+
+void TiledImageItem::onTileDecoded(quint64 sourceId, quint64 key,
+                                   const QImage &tile) {
+  if (sourceId != m_sourceId) {
+    return;
+  }
+  m_pendingTiles.remove(key);
+
+  if (!tile.isNull()) {
+    m_tiles.insert(key, new QImage(tile),
+                   std::max<qsizetype>(1, tile.sizeInBytes() / 1024));
+    update();
+  }
+}
+
+void TiledImageItem::onTileDropped(quint64 sourceId, quint64 key) {
+  if (sourceId != m_sourceId) {
+    return;
+  }
+  m_pendingTiles.remove(key);
+
+  // Still visible tiles get requested again on the next paint
+  update();
+}
\ No newline at end of file
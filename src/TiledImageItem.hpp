@@ -0,0 +1,63 @@
+#pragma once
+#include <QCache>
+#include <QGraphicsObject>
+#include <QImage>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+
+#include <atomic>
+
+/// Draws a very large image as a mip pyramid of fixed-size tiles.
+///
+/// Only the tiles that intersect the exposed part of the view are decoded,
+/// at the pyramid level matching the current zoom, using
+/// QImageReader::setClipRect so the rest of the file is never expanded in
+/// memory. Decoded tiles live in a cache bounded by bytes, so memory use
+/// follows the screen size rather than the image size.
+///
+/// The item covers the full resolution image centered on the origin and
+/// only paints once the view is zoomed in far enough for tiles to show
+/// more detail than the proxy pixmap underneath.
+class TiledImageItem : public QGraphicsObject {
+  Q_OBJECT
+
+  static constexpr inline int TILE_SIZE = 512;
+  static constexpr inline int TILE_CACHE_KB = 256 * 1024;
+
+  QString m_imagePath;
+  quint64 m_sourceId{0};
+  QSize m_imageSize;
+  int m_levels{1};
+  qreal m_proxyScale{1.0};
+
+  /// Bumped when the source changes or the visible tiles change.
+  /// Queued tile decodes from older generations are dropped
+  std::atomic<quint64> m_generation{0};
+  quint64 m_visibleTilesKey{0};
+
+  QCache<quint64, QImage> m_tiles;
+  QSet<quint64> m_pendingTiles;
+  QThreadPool m_pool;
+
+public:
+  TiledImageItem(QGraphicsItem *parent = nullptr);
+  ~TiledImageItem();
+
+  void setSource(const QString &imagePath, const QSize &imageSize,
+                 qreal proxyScale);
+  void clear();
+  bool hasSource() const { return !m_imagePath.isEmpty(); }
+
+  QRectF boundingRect() const override;
+  void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+             QWidget *widget = nullptr) override;
+
+private:
+  static quint64 tileKey(int level, int x, int y);
+  QRect tileRect(int level, int x, int y) const;
+  void requestTile(int level, int x, int y);
+  void onTileDecoded(quint64 sourceId, quint64 key, const QImage &tile);
+  void onTileDropped(quint64 sourceId, quint64 key);
+};
\ No newline at end of file
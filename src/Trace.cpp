@@ -0,0 +1,283 @@
+#include "Trace.hpp"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+const Clock::time_point PROCESS_START = Clock::now();
+
+/// The event written into a slot as the n-th of its ring has sequence
+/// 2n + 2 once complete and 2n + 1 while it is being written, like a
+/// seqlock. Readers keep a copy only if the sequence was the complete
+/// one before and after copying
+struct Slot {
+  std::atomic<quint64> sequence{0};
+  Trace::Event event;
+};
+
+/// Written only by the thread that holds it, read while it keeps
+/// recording
+struct Ring {
+  std::array<Slot, Trace::RING_EVENTS> slots;
+  std::atomic<quint64> head{0};
+};
+
+/// Rings outlive their threads, so events of finished workers still end
+/// up in the trace. A ring left by a finished thread is handed to the
+/// next new one, which bounds their number by the peak thread count
+struct Registry {
+  QMutex mutex;
+  std::vector<std::unique_ptr<Ring>> rings;
+  std::vector<Ring *> freeRings;
+  std::vector<QString> threadNames; // indexed by thread number
+
+  /// Events from before recording was last turned on are left out
+  std::atomic<qint64> recordingSince{0};
+};
+
+/// Never destroyed, workers may still record during static destruction
+Registry &registry() {
+  static auto *instance = new Registry;
+  return *instance;
+}
+
+struct ThreadRing {
+  Ring *ring{nullptr};
+  quint32 thread{0};
+
+  ThreadRing() {
+    auto &shared = registry();
+    QMutexLocker locker(&shared.mutex);
+
+    if (shared.freeRings.empty()) {
+      shared.rings.push_back(std::make_unique<Ring>());
+      ring = shared.rings.back().get();
+    } else {
+      ring = shared.freeRings.back();
+      shared.freeRings.pop_back();
+    }
+
+    QString name = QThread::currentThread()->objectName();
+    if (name.isEmpty()) {
+      const auto *application = QCoreApplication::instance();
+      name = application && application->thread() == QThread::currentThread()
+                 ? "Main thread"
+                 : "Worker";
+    }
+    thread = quint32(shared.threadNames.size());
+    shared.threadNames.push_back(name);
+  }
+
+  ~ThreadRing() {
+    auto &shared = registry();
+    QMutexLocker locker(&shared.mutex);
+    shared.freeRings.push_back(ring);
+  }
+};
+
+void copyDetail(char *destination, const QString &detail) {
+  const QByteArray utf8 = detail.toUtf8();
+  const auto length =
+      std::min<std::size_t>(utf8.size(), Trace::DETAIL_BYTES - 1);
+  std::memcpy(destination, utf8.constData(), length);
+  destination[length] = '\0';
+}
+
+QJsonObject toJson(const Trace::Event &event, qint64 pid) {
+  QJsonObject json{{"cat", event.category},
+                   {"name", event.name},
+                   {"ph", QString(QChar(event.phase))},
+                   {"ts", event.start / 1000.0},
+                   {"pid", pid},
+                   {"tid", qint64(event.thread)}};
+  if (event.phase == 'X') {
+    json["dur"] = event.duration / 1000.0;
+  } else if (event.phase == 'C') {
+    json["args"] = QJsonObject{{event.name, qint64(event.id)}};
+    return json;
+  } else {
+    json["id"] = QString::number(event.id, 16);
+  }
+  if (event.detail[0] != '\0') {
+    json["args"] = QJsonObject{{"detail", QString::fromUtf8(event.detail)}};
+  }
+  return json;
+}
+
+} // namespace
+
+qint64 Trace::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              PROCESS_START)
+      .count();
+}
+
+Trace::Span::Span(const char *category, const char *name)
+    : m_category(category), m_name(name) {
+  if (isEnabled()) {
+    m_detail[0] = '\0';
+    m_start = now();
+  }
+}
+
+Trace::Span::Span(const char *category, const char *name,
+                  const QString &detail)
+    : m_category(category), m_name(name) {
+  if (isEnabled()) {
+    copyDetail(m_detail, detail);
+    m_start = now();
+  }
+}
+
+Trace::Span::~Span() {
+  if (m_start < 0 || !isEnabled()) {
+    return;
+  }
+
+  Event event;
+  event.category = m_category;
+  event.name = m_name;
+  event.start = m_start;
+  event.duration = now() - m_start;
+  event.id = 0;
+  event.phase = 'X';
+  std::memcpy(event.detail, m_detail, DETAIL_BYTES);
+  record(event);
+}
+
+void Trace::asyncBegin(const char *category, const char *name, quint64 id) {
+  if (!isEnabled()) {
+    return;
+  }
+  Event event{category, name, now(), 0, id, 0, 'b', {}};
+  record(event);
+}
+
+void Trace::asyncEnd(const char *category, const char *name, quint64 id) {
+  if (!isEnabled()) {
+    return;
+  }
+  Event event{category, name, now(), 0, id, 0, 'e', {}};
+  record(event);
+}
+
+void Trace::counter(const char *category, const char *name, qint64 value) {
+  if (!isEnabled()) {
+    return;
+  }
+  Event event{category, name, now(), 0, quint64(value), 0, 'C', {}};
+  record(event);
+}
+
+void Trace::record(Event &event) {
+  thread_local ThreadRing threadRing;
+  Ring *ring = threadRing.ring;
+
+  event.thread = threadRing.thread;
+  const quint64 head = ring->head.load(std::memory_order_relaxed);
+  auto &slot = ring->slots[head % RING_EVENTS];
+  slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = event;
+  slot.sequence.store(2 * head + 2, std::memory_order_release);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::setEnabled(bool enabled) {
+  if (enabled) {
+    registry().recordingSince.store(now());
+  }
+  s_enabled.store(enabled);
+}
+
+bool Trace::writeChromeTrace(const QString &path, QString *error) {
+  auto &shared = registry();
+  const qint64 since = shared.recordingSince.load();
+  const qint64 pid = QCoreApplication::applicationPid();
+
+  QJsonArray events;
+  std::vector<QString> threadNames;
+  {
+    QMutexLocker locker(&shared.mutex);
+    threadNames = shared.threadNames;
+
+    for (const auto &ring : shared.rings) {
+      const quint64 head = ring->head.load(std::memory_order_acquire);
+      const quint64 first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+
+      for (quint64 i = first; i < head; ++i) {
+        // The owner may be overwriting the slot with a newer
+        // event, the copy is torn then and left out
+        const auto &slot = ring->slots[i % RING_EVENTS];
+        const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * i + 2) {
+          continue;
+        }
+        const Event event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+          continue;
+        }
+
+        if (event.start >= since) {
+          events.append(toJson(event, pid));
+        }
+      }
+    }
+  }
+
+  for (std::size_t thread = 0; thread < threadNames.size(); ++thread) {
+    events.append(QJsonObject{
+        {"name", "thread_name"},
+        {"ph", "M"},
+        {"pid", pid},
+        {"tid", qint64(thread)},
+        {"args", QJsonObject{{"name", threadNames[thread]}}}});
+  }
+
+  const QJsonObject trace{{"traceEvents", events},
+                          {"displayTimeUnit", "ms"}};
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly) ||
+      file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) < 0 ||
+      !file.commit()) {
+    if (error) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+  return true;
+}
+
+void Trace::startFromEnvironment() {
+  if (!qEnvironmentVariableIsEmpty(ENVIRONMENT_VARIABLE)) {
+    setEnabled(true);
+  }
+}
+
+void Trace::finishFromEnvironment() {
+  if (qEnvironmentVariableIsEmpty(ENVIRONMENT_VARIABLE)) {
+    return;
+  }
+
+  // No window is left to show it in
+  const QString path = qEnvironmentVariable(ENVIRONMENT_VARIABLE);
+  QString error;
+  if (!writeChromeTrace(path, &error)) {
+    qWarning() << "Cannot write the trace to" << path << error;
+  }
+}
\ No newline at end of file
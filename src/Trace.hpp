@@ -0,0 +1,86 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+#include <cstddef>
+
+/// Timing spans recorded into per-thread ring buffers and written out as
+/// Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev
+/// open.
+///
+/// Recording is off until setEnabled(true), from the "Record Trace" menu
+/// item or the IMAGEVIEWER_TRACE environment variable. When it is off, a
+/// span costs one relaxed load. When it is on, a span reads the clock
+/// twice and writes one event into a ring owned by its thread, with no
+/// locks and no allocation. Each ring keeps the newest RING_EVENTS events.
+///
+/// Category and name must be string literals, only the pointers are
+/// stored.
+class Trace {
+public:
+  static constexpr inline std::size_t RING_EVENTS = 8192;
+  static constexpr inline std::size_t DETAIL_BYTES = 48;
+
+  /// Path to write the trace to when the application exits. Setting it
+  /// also turns recording on at startup
+  static constexpr inline char ENVIRONMENT_VARIABLE[] = "IMAGEVIEWER_TRACE";
+
+  struct Event {
+    const char *category;
+    const char *name;
+    qint64 start;    // ns since the process started
+    qint64 duration; // ns, complete events only
+    quint64 id;      // async events only, the value of counters
+    quint32 thread;
+    char phase; // 'X' complete, 'b' async begin, 'e' async end, 'C' counter
+    char detail[DETAIL_BYTES];
+  };
+
+  /// Records the time from construction to destruction
+  class Span {
+    const char *m_category;
+    const char *m_name;
+    qint64 m_start{-1};
+    char m_detail[DETAIL_BYTES];
+
+  public:
+    Span(const char *category, const char *name);
+    /// `detail` is shown with the span, a file name for example
+    Span(const char *category, const char *name, const QString &detail);
+    ~Span();
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+  };
+
+  static bool isEnabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Turning recording on drops whatever was recorded before
+  static void setEnabled(bool enabled);
+
+  /// Spans across threads, ended by the event with the same name and id
+  static void asyncBegin(const char *category, const char *name, quint64 id);
+  static void asyncEnd(const char *category, const char *name, quint64 id);
+
+  /// A value plotted over time, e.g. frames dropped so far
+  static void counter(const char *category, const char *name, qint64 value);
+
+  /// Safe while recording, events being written at that moment are
+  /// left out. On failure `error`, if given, says why
+  static bool writeChromeTrace(const QString &path, QString *error = nullptr);
+
+  /// Start recording if the environment variable names a file
+  static void startFromEnvironment();
+  /// Write to the file the environment variable names, if any
+  static void finishFromEnvironment();
+
+  static qint64 now();
+
+private:
+  static inline std::atomic<bool> s_enabled{false};
+
+  static void record(Event &event);
+};
\ No newline at end of file
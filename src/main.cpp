@@ -1,7 +1,22 @@
+#include "CachePrewarmer.hpp"
 #include "MainWindow.hpp"
+#include "Trace.hpp"
 
 int main(int argc, char *argv[]) {
+  if (CachePrewarmer::requested(argc, argv)) {
+    // Pixmaps need a GUI application, not a screen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    Trace::startFromEnvironment();
+    const int result = CachePrewarmer::run(app);
+    Trace::finishFromEnvironment();
+    return result;
+  }
+
   QApplication app(argc, argv);
+  Trace::startFromEnvironment();
 
   MainWindow mainWindow;
   mainWindow.setWindowTitle("Resizable Collapsible Sidebar");
@@ -10,7 +25,9 @@ int main(int argc, char *argv[]) {
 
   mainWindow.show();
 
-  return app.exec();
+  const int result = app.exec();
+  Trace::finishFromEnvironment();
+  return result;
 }
 
 #include "main.moc"
\ No newline at end of file
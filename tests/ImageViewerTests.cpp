@@ -0,0 +1,269 @@
+/// Unit tests for the pure logic behind the viewer: scheduling, caching
+/// and the file index. Nothing here decodes images or opens windows, it
+/// runs on the offscreen platform.
+/// Build with -DIMAGEVIEWER_BUILD_TESTS=ON and run through ctest.
+#include <QFile>
+#include <QFileInfo>
+#include <QPixmap>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "ImageCache.hpp"
+#include "ImageFileIndex.hpp"
+#include "PrefetchWindow.hpp"
+#include "SlideshowScheduler.hpp"
+
+#include <vector>
+
+using Indices = std::vector<std::size_t>;
+
+class ImageViewerTests : public QObject {
+  Q_OBJECT
+
+  QTemporaryDir m_directory;
+
+  QString makeFile(const QString &name, int bytes);
+  static QStringList names(const ImageFileIndex &index);
+
+private slots:
+  void initTestCase();
+
+  void fileIndexRemovesThroughLiveSlots();
+  void fileIndexSortKeepsTiesInBothOrders();
+
+  void prefetchStopsAtTheEnds();
+  void prefetchFollowsTheDirection();
+  void imageCacheEvictsAtTheBudget();
+
+  void slideshowFramesAhead();
+  void slideshowWrapsAroundWhenLooping();
+  void slideshowCountsMissedDeadlines();
+};
+
+QString ImageViewerTests::makeFile(const QString &name, int bytes) {
+  const QString path = m_directory.filePath(name);
+  QFile file(path);
+  if (file.open(QIODevice::WriteOnly)) {
+    file.write(QByteArray(bytes, '\0'));
+  }
+  return path;
+}
+
+QStringList ImageViewerTests::names(const ImageFileIndex &index) {
+  QStringList result;
+  for (std::size_t i = 0; i < index.size(); ++i) {
+    result.append(QFileInfo(index.path(i)).fileName());
+  }
+  return result;
+}
+
+void ImageViewerTests::initTestCase() {
+  QVERIFY(m_directory.isValid());
+
+  /// The index looks files up in the disk cache, keep it out of the
+  /// user's cache directory
+  qputenv("XDG_CACHE_HOME", QFile::encodeName(m_directory.filePath("cache")));
+}
+
+void ImageViewerTests::fileIndexRemovesThroughLiveSlots() {
+  std::vector<QString> paths;
+  for (int i = 0; i < 12; ++i) {
+    paths.push_back(makeFile(QString("remove%1.jpg").arg(i, 2, 10, QChar('0')),
+                             1));
+  }
+  ImageFileIndex index;
+  index.assign(paths);
+  std::vector<QString> expected = paths;
+
+  /// Removals leave dead slots, which the Fenwick tree skips, until
+  /// the seventh makes them outweigh the live ones and compacts
+  for (const std::size_t position : {3, 7, 0, 8, 2, 2, 0}) {
+    const QString removed = expected[position];
+    index.remove(position);
+    expected.erase(expected.begin() + std::ptrdiff_t(position));
+
+    QVERIFY(!index.contains(removed));
+    QVERIFY(!index.indexOf(removed));
+    QCOMPARE(index.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      QCOMPARE(index.path(i), expected[i]);
+      QCOMPARE(index.indexOf(expected[i]), std::optional<std::size_t>(i));
+    }
+  }
+}
+
+void ImageViewerTests::fileIndexSortKeepsTiesInBothOrders() {
+  const auto a = makeFile("tie-a.jpg", 10);
+  const auto b = makeFile("tie-b.jpg", 20);
+  const auto c = makeFile("tie-c.jpg", 20);
+  const auto d = makeFile("tie-d.jpg", 20);
+  const auto e = makeFile("tie-e.jpg", 5);
+
+  ImageFileIndex index;
+  index.assign({d, a, c, e, b});
+  index.sort(SortBy::name, SortOrder::ascending);
+  QCOMPARE(names(index), QStringList({"tie-a.jpg", "tie-b.jpg", "tie-c.jpg",
+                                      "tie-d.jpg", "tie-e.jpg"}));
+
+  /// b, c and d are the same size and stay in name order
+  index.sort(SortBy::size, SortOrder::descending);
+  QCOMPARE(names(index), QStringList({"tie-b.jpg", "tie-c.jpg", "tie-d.jpg",
+                                      "tie-a.jpg", "tie-e.jpg"}));
+  index.sort(SortBy::size, SortOrder::ascending);
+  QCOMPARE(names(index), QStringList({"tie-e.jpg", "tie-a.jpg", "tie-b.jpg",
+                                      "tie-c.jpg", "tie-d.jpg"}));
+}
+
+void ImageViewerTests::prefetchStopsAtTheEnds() {
+  PrefetchWindow window;
+  window.setExtent(3, 1);
+
+  QCOMPARE(window.plan(0, 10), Indices({1, 2, 3}));
+  QCOMPARE(window.plan(5, 10), Indices({6, 7, 8, 4}));
+  QCOMPARE(window.plan(8, 10), Indices({9, 7}));
+
+  /// Only a slideshow wraps around, see SlideshowScheduler
+  QCOMPARE(window.plan(9, 10), Indices({8}));
+
+  QCOMPARE(window.plan(0, 1), Indices());
+  QCOMPARE(window.plan(10, 10), Indices());
+  QCOMPARE(window.plan(0, 0), Indices());
+}
+
+void ImageViewerTests::prefetchFollowsTheDirection() {
+  PrefetchWindow window;
+  window.setExtent(3, 1);
+
+  QCOMPARE(window.direction(), PrefetchWindow::Direction::forward);
+  window.recordStep(-1);
+  QCOMPARE(window.direction(), PrefetchWindow::Direction::backward);
+  QCOMPARE(window.plan(5, 10), Indices({4, 3, 2, 6}));
+  QCOMPARE(window.plan(0, 10), Indices({1}));
+  QCOMPARE(window.plan(9, 10), Indices({8, 7, 6}));
+
+  /// Slideshows go forward and never look behind
+  window.setSlideshowRunning(true);
+  QCOMPARE(window.direction(), PrefetchWindow::Direction::forward);
+  QCOMPARE(window.plan(5, 10), Indices({6, 7, 8}));
+  QCOMPARE(window.plan(9, 10), Indices());
+}
+
+void ImageViewerTests::imageCacheEvictsAtTheBudget() {
+  QPixmap pixmap(16, 16);
+  pixmap.fill(Qt::gray);
+  const qint64 bytes = ImageCache::bytesFor(pixmap);
+  QVERIFY(bytes > 0);
+
+  ImageCache cache(3 * bytes);
+  const ImageCacheKey a{"a.jpg", 1, 0};
+  const ImageCacheKey b{"b.jpg", 1, 0};
+  const ImageCacheKey c{"c.jpg", 1, 0};
+  const ImageCacheKey d{"d.jpg", 1, 0};
+  cache.insert(a, pixmap, {});
+  cache.insert(b, pixmap, {});
+  cache.insert(c, pixmap, {});
+  QCOMPARE(cache.usedBytes(), 3 * bytes);
+
+  /// A hit makes `a` the most recent, so `b` is the one to go
+  QVERIFY(cache.find(a));
+  cache.insert(d, pixmap, {});
+  QCOMPARE(cache.usedBytes(), 3 * bytes);
+  QVERIFY(cache.contains(a));
+  QVERIFY(!cache.contains(b));
+  QVERIFY(cache.contains(c));
+  QVERIFY(cache.contains(d));
+
+  /// Inserting a key again replaces the entry instead of counting twice
+  cache.insert(c, pixmap, {});
+  QCOMPARE(cache.usedBytes(), 3 * bytes);
+
+  /// Larger than the whole budget, not cached at all
+  QPixmap large(64, 64);
+  large.fill(Qt::gray);
+  cache.insert({"large.jpg", 1, 0}, large, {});
+  QVERIFY(!cache.contains({"large.jpg", 1, 0}));
+  QCOMPARE(cache.usedBytes(), 3 * bytes);
+
+  /// Shrinking the budget keeps the most recently used
+  cache.setBudget(bytes);
+  QCOMPARE(cache.usedBytes(), bytes);
+  QVERIFY(cache.contains(c));
+
+  cache.remove("c.jpg");
+  QCOMPARE(cache.usedBytes(), qint64(0));
+}
+
+void ImageViewerTests::slideshowFramesAhead() {
+  SlideshowScheduler scheduler;
+  scheduler.start(0, 1000, false);
+
+  /// Nothing decoded yet, the minimum
+  QCOMPARE(scheduler.framesAhead(), SlideshowScheduler::MIN_FRAMES_AHEAD);
+
+  /// 1.5 periods of decoding, plus the frame due next
+  scheduler.recordDecode(1000);
+  QCOMPARE(scheduler.framesAhead(), 3);
+
+  /// Moving average: 0.75 * 1000 + 0.25 * 10000 = 3250 ms
+  scheduler.recordDecode(10000);
+  QCOMPARE(scheduler.framesAhead(), 6);
+
+  /// A shorter period needs more frames in flight, up to the cap
+  scheduler.setPeriod(100);
+  QCOMPARE(scheduler.framesAhead(), SlideshowScheduler::MAX_FRAMES_AHEAD);
+}
+
+void ImageViewerTests::slideshowWrapsAroundWhenLooping() {
+  SlideshowScheduler scheduler;
+  scheduler.start(0, 1000, false);
+  scheduler.recordDecode(1000);
+
+  std::size_t index = 0;
+  QVERIFY(scheduler.next(3, 5, index));
+  QCOMPARE(index, std::size_t(4));
+  QVERIFY(!scheduler.next(4, 5, index));
+  QVERIFY(!scheduler.next(0, 0, index));
+  QCOMPARE(scheduler.plan(3, 5), Indices({4}));
+
+  scheduler.setLoop(true);
+  QVERIFY(scheduler.next(4, 5, index));
+  QCOMPARE(index, std::size_t(0));
+  QCOMPARE(scheduler.plan(3, 5), Indices({4, 0, 1}));
+
+  /// Fewer images than frames ahead, the current one is not planned
+  QCOMPARE(scheduler.plan(0, 2), Indices({1}));
+  QCOMPARE(scheduler.plan(0, 1), Indices());
+}
+
+void ImageViewerTests::slideshowCountsMissedDeadlines() {
+  SlideshowScheduler scheduler;
+  scheduler.start(0, 1000, true);
+  QCOMPARE(scheduler.nextDeadline(), qint64(1000));
+
+  scheduler.frameDue(1000, true);
+  QCOMPARE(scheduler.nextDeadline(), qint64(2000));
+  QCOMPARE(scheduler.missedDeadlines(), 0);
+
+  /// Late: no deadline until it is shown, then a whole period
+  scheduler.frameDue(2000, false);
+  QCOMPARE(scheduler.missedDeadlines(), 1);
+  QVERIFY(scheduler.isWaiting());
+  scheduler.frameShown(2600);
+  QVERIFY(!scheduler.isWaiting());
+  QCOMPARE(scheduler.nextDeadline(), qint64(3600));
+
+  /// After a stall the schedule starts over instead of catching up
+  scheduler.frameDue(10000, true);
+  QCOMPARE(scheduler.nextDeadline(), qint64(11000));
+  QCOMPARE(scheduler.framesShown(), 3);
+  QCOMPARE(scheduler.missedDeadlines(), 1);
+
+  /// A new slideshow starts counting again
+  scheduler.start(20000, 1000, true);
+  QCOMPARE(scheduler.framesShown(), 0);
+  QCOMPARE(scheduler.missedDeadlines(), 0);
+}
+
+QTEST_MAIN(ImageViewerTests)
+
+#include "ImageViewerTests.moc"